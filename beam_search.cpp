@@ -0,0 +1,347 @@
+#include <cstdio>
+#include <algorithm>
+#include "beam_search.h"
+
+// an uncleared fire that no ice block can reach counts as this many pushes
+static const double UNREACHABLE_PENALTY = 64;
+// at most this many times the width of states cut from the beam are kept
+// in reserve
+static const size_t RESERVE_PER_WIDTH = 16;
+
+template <class G>
+BeamSearch<G>::BeamSearch(BoardView<G>& bview, const State<G>& root,
+                          size_t width, double weight, unsigned int maxDepth):
+    bview(bview), width(width), weight(weight), maxDepth(maxDepth) {
+    nodes.push_back(root);
+    current = &nodes.front();
+
+    vector<int> pushables;
+    exploreBoard(bview, pushables);
+    rootMagicianPos = bview.magicianPos;
+    seen.insert(bview.canonicalHash());
+
+    computeFireDistances();
+}
+
+// where an ice block pushed from pos would stop on an otherwise empty
+// floor, or -1 if it is destroyed or goes round a loop of arrows; the
+// cells it passes go to `path` and the fires it clears to `fires`. Like
+// pushIceBlock(), a push into a loop is not made and clears nothing, but
+// the cells of the loop are still where a stopper could hold the block.
+template <class G>
+int BeamSearch<G>::slideStatically(int pos, Direction d, bool isGoldIce,
+                                   vector<int>& path, vector<int>& fires) const {
+    const int DIRS = static_cast<int>(Direction::_ALL);
+    auto& map = bview.config.map;
+    int npos = pos, dir = static_cast<int>(d);
+    bitset<G::MAP_SIZE * DIRS> passed;
+    path.clear();
+    fires.clear();
+
+    for (;;) {
+        if (passed[npos * DIRS + dir]) {
+            fires.clear();
+            return -1;
+        }
+        passed[npos * DIRS + dir] = 1;
+
+        int peek, ndir = dir;
+        if constexpr (G::SPECIAL_TILES) {
+            peek = bview.slide[npos][dir].pos;
+            ndir = bview.slide[npos][dir].dir;
+        } else {
+            peek = BoardView<G>::next[npos][dir];
+        }
+        if (peek <= 0 || map[peek] == ObjectType::WALL || map[peek] == ObjectType::DISPENSER) {
+            break;
+        }
+
+        npos = peek;
+        dir = ndir;
+
+        if (map[peek] == ObjectType::RECYCLER && !isGoldIce) {
+            return -1;
+        }
+        if (map[peek] == ObjectType::FIRE) {
+            fires.push_back(bview.fireToIndex[peek]);
+            if (!isGoldIce) {
+                return -1;
+            }
+        }
+        path.push_back(peek);
+    }
+
+    if (!path.empty()) {
+        path.pop_back();
+    }
+    return npos;
+}
+
+// The distances are taken on a relaxed floor where ice blocks do not meet
+// each other, except that a block may stop anywhere along its slide for
+// one more push, standing for the one that put a stopper in its way.
+template <class G>
+void BeamSearch<G>::computeFireDistances() {
+    const int N = G::MAP_SIZE;
+    const int F = bview.config.fires.size();
+    auto& map = bview.config.map;
+
+    fireDist.assign(2 * F * N, UNREACHABLE);
+    vector<int> path, hit;
+    vector<vector<int>> buckets;
+
+    for (int type = 0; type < 2; type++) {
+        uint16_t* dist = &fireDist[type * F * N];
+        // rev[q] lists (p, cost): an ice block at p can be brought to q
+        vector<vector<pair<int, int>>> rev(N);
+
+        for (int p = 0; p < N; p++) {
+            if (map[p] == ObjectType::WALL) {
+                continue;
+            }
+            for (int d = 0; d < static_cast<int>(Direction::_ALL); d++) {
+                Direction dir = static_cast<Direction>(d);
+                int behind = BoardView<G>::next[p][static_cast<int>(oppositeDirection(dir))];
+                if (behind <= 0 || map[behind] == ObjectType::WALL || map[behind] == ObjectType::DISPENSER) {
+                    continue;
+                }
+
+                int q = slideStatically(p, dir, type == 1, path, hit);
+                for (auto f: hit) {
+                    dist[f * N + p] = 1;
+                }
+                if (q >= 0 && q != p) {
+                    rev[q].push_back({p, 1});
+                }
+                for (auto r: path) {
+                    if (r != p) {
+                        rev[r].push_back({p, 2});
+                    }
+                }
+            }
+        }
+
+        // Dijkstra with small integer costs, one bucket per distance
+        for (int f = 0; f < F; f++) {
+            uint16_t* fdist = dist + f * N;
+            buckets.assign(2, {});
+            for (int p = 0; p < N; p++) {
+                if (fdist[p] == 1) {
+                    buckets[1].push_back(p);
+                }
+            }
+            for (size_t k = 1; k < buckets.size(); k++) {
+                for (size_t i = 0; i < buckets[k].size(); i++) {
+                    int q = buckets[k][i];
+                    if (fdist[q] != k) {
+                        continue;
+                    }
+                    for (auto [p, cost]: rev[q]) {
+                        size_t nd = k + cost;
+                        if (nd < fdist[p]) {
+                            fdist[p] = nd;
+                            if (buckets.size() <= nd) {
+                                buckets.resize(nd + 1);
+                            }
+                            buckets[nd].push_back(p);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <class G>
+double BeamSearch<G>::heuristic() const {
+    const int N = G::MAP_SIZE;
+    const int F = bview.config.fires.size();
+
+    // (position, type) of every ice block that can still be pushed
+    pair<int, int> ices[N];
+    int iceCount = 0;
+    for (int p = 0; p < N; p++) {
+        int idx = bview.pushableIceAt(p);
+        if (idx >= 0) {
+            ices[iceCount++] = {p, bview.config.iceType[idx]};
+        }
+    }
+
+    // a normal ice block is gone once it clears a fire, so fires are
+    // assigned ice blocks greedily, each normal one used at most once
+    bool used[N];
+    fill(used, used + iceCount, false);
+
+    double h = 0;
+    for (int f = 0; f < F; f++) {
+        if (!bview.isMarked(bview.config.fires[f])) {
+            continue;
+        }
+        uint16_t best = UNREACHABLE;
+        int bestIce = -1;
+        for (int i = 0; i < iceCount; i++) {
+            auto [p, type] = ices[i];
+            uint16_t dist = fireDist[(type * F + f) * N + p];
+            if (!used[i] && dist < best) {
+                best = dist;
+                bestIce = i;
+            }
+        }
+        if (bestIce >= 0 && ices[bestIce].second == 0) {
+            used[bestIce] = true;
+        }
+        h += (best == UNREACHABLE ? UNREACHABLE_PENALTY : best);
+    }
+    return h;
+}
+
+// bring the view to a kept state, with its magician not yet normalized
+template <class G>
+void BeamSearch<G>::moveTo(const State<G>& s) {
+    bview.transit(*current, s);
+    current = &s;
+    bview.setMagicianPos(s.age == 0 ? rootMagicianPos : s.magicianPos);
+}
+
+template <class G>
+void BeamSearch<G>::buildSolution(const State<G>& goal) {
+    vector<const State<G>*> path;
+    for (const State<G>* s = &goal; s->age != 0; s = s->previous) {
+        path.push_back(s);
+    }
+    reverse(path.begin(), path.end());
+
+    moveTo(nodes.front());
+
+    // replay the pushes to recover the fires each of them clears
+    solution_.clear();
+    solution_.reserve(path.size());
+    const State<G>* prev = &nodes.front();
+    for (auto s: path) {
+        solution_.emplace_back();
+        pushIceBlock(bview, *prev, s->oldPosition, pushDirection(*s), solution_.back());
+        bview.apply(solution_.back());
+        prev = s;
+    }
+    for (auto it = solution_.rbegin(); it != solution_.rend(); ++it) {
+        bview.unapply(*it);
+    }
+}
+
+template <class G>
+bool BeamSearch<G>::run() {
+    vector<const State<G>*> beam {&nodes.front()};
+    vector<Candidate> candidates;
+    unordered_set<uint64_t> layer;
+    vector<int> pushables, scratch;
+    BoardChange<G> change;
+    bool pruned = false;
+
+    if (nodes.front().clearedFiresPatId == 1) {
+        return true;
+    }
+    exhaustedDepth_ = 0;
+
+    for (unsigned int depth = 0; depth < maxDepth && !beam.empty(); depth++) {
+        candidates.clear();
+        layer.clear();
+
+        for (auto node: beam) {
+            moveTo(*node);
+            exploreBoard(bview, pushables, moveCache);
+            unsigned int normalizedPos = bview.magicianPos;
+
+            for (auto p: pushables) {
+                if (budget.exhausted()) {
+                    moveTo(nodes.front());
+                    return false;
+                }
+
+                Direction dir = static_cast<Direction>(p & 0xff);
+                if (!pushIceBlock(bview, *node, p >> 8, dir, change)) {
+                    continue;
+                }
+                bview.apply(change);
+                bview.setMagicianPos(change.state.magicianPos);
+                exploreBoard(bview, scratch, moveCache);
+                exploredStateCount_++;
+
+                bool solved = false;
+                uint64_t hash = bview.canonicalHash();
+                if (!seen.count(hash) && layer.insert(hash).second) {
+                    solved = (change.state.clearedFiresPatId == 1);
+                    if (!solved) {
+                        candidates.push_back({change.state, change.state.age + weight * heuristic(), hash});
+                    }
+                }
+
+                bview.unapply(change);
+                bview.setMagicianPos(normalizedPos);
+
+                if (solved) {
+                    nodes.push_back(change.state);
+                    buildSolution(nodes.back());
+                    return true;
+                }
+            }
+        }
+
+        stable_sort(candidates.begin(), candidates.end(), [](auto& a, auto& b) {
+            return a.score < b.score;
+        });
+
+        if (verbose) {
+            printf("Beam layer %u: %zd new states, best score %.1f\n",
+                   depth + 1, candidates.size(), candidates.empty() ? 0.0 : candidates[0].score);
+        }
+
+        auto byScore = [](auto& a, auto& b) { return a.score < b.score; };
+        if (width && candidates.size() > width) {
+            reserve.insert(reserve.end(), candidates.begin() + width, candidates.end());
+            candidates.erase(candidates.begin() + width, candidates.end());
+            pruned = true;
+            if (reserve.size() > RESERVE_PER_WIDTH * width) {
+                nth_element(reserve.begin(), reserve.begin() + RESERVE_PER_WIDTH * width,
+                            reserve.end(), byScore);
+                reserve.resize(RESERVE_PER_WIDTH * width);
+            }
+        } else if (width && !reserve.empty()) {
+            // a thin layer is topped up with the best states cut before, so
+            // that the beam does not die out in dead ends
+            sort(reserve.begin(), reserve.end(), byScore);
+            size_t taken = 0;
+            while (taken < reserve.size() && candidates.size() < width) {
+                auto& c = reserve[taken++];
+                if (!seen.count(c.hash) && layer.insert(c.hash).second) {
+                    candidates.push_back(c);
+                }
+            }
+            reserve.erase(reserve.begin(), reserve.begin() + taken);
+        }
+        if (!pruned) {
+            exhaustedDepth_ = depth + 1;
+        }
+
+        // states taken back from the reserve are shallower than the layer
+        unsigned int shortest = depth + 2;
+        beam.clear();
+        for (auto& c: candidates) {
+            seen.insert(c.hash);
+            nodes.push_back(c.state);
+            beam.push_back(&nodes.back());
+            shortest = min<unsigned int>(shortest, c.state.age + 1);
+        }
+
+        if (onLayer && !onLayer(exhaustedDepth_, shortest)) {
+            break;
+        }
+    }
+
+    moveTo(nodes.front());
+    return false;
+}
+
+#define INSTANTIATE_BEAM_SEARCH(W, H) \
+    template class BeamSearch<Geometry<W, H, false>>; \
+    template class BeamSearch<Geometry<W, H, true>>;
+QITS_GEOMETRIES(INSTANTIATE_BEAM_SEARCH)
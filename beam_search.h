@@ -0,0 +1,84 @@
+#ifndef __QITS_BEAM_SEARCH_H
+#define __QITS_BEAM_SEARCH_H
+
+#include <deque>
+#include <functional>
+#include <unordered_set>
+#include "qits.h"
+#include "board_view.h"
+#include "move_cache.h"
+
+// Inexact search for floors beyond the reach of iterative deepening.
+// Layers are expanded breadth-first, and only the `width` best states of
+// each layer are kept, scored by
+//
+//     pushes + weight * (sum over remaining fires of the fewest pushes
+//                        any ice block would need to clear it alone)
+//
+// With width 0 every layer is kept whole, and with weight 0 as well this
+// is a plain BFS that finds an optimal solution.
+template <class G>
+class BeamSearch {
+public:
+    BeamSearch(BoardView<G>& bview, const State<G>& root,
+               size_t width, double weight, unsigned int maxDepth);
+
+    // whether a solution was found; the view is back at the root afterwards
+    bool run();
+
+    const vector<BoardChange<G>>& solution() const { return solution_; }
+    size_t exploredStateCount() const { return exploredStateCount_; }
+    // the last layer that was expanded in full without finding a
+    // solution, or -1; only a proof of anything when nothing was pruned
+    int exhaustedDepth() const { return exhaustedDepth_; }
+
+    SearchBudget budget;
+    bool verbose = true;
+    // optional, and may be shared with other searches on the same floor
+    MoveCache<G>* moveCache = nullptr;
+    // optional; after each layer, given exhaustedDepth() and the length of
+    // the shortest solution the next layer could find, and the search ends
+    // unless it returns true
+    function<bool(int, unsigned int)> onLayer;
+
+private:
+    static constexpr uint16_t UNREACHABLE = 0xffff;
+
+    struct Candidate {
+        State<G> state;
+        double score;
+        uint64_t hash;
+    };
+
+    BoardView<G>& bview;
+    const size_t width;
+    const double weight;
+    const unsigned int maxDepth;
+
+    // stable storage for every kept state, as they are linked by `previous`
+    deque<State<G>> nodes;
+    unsigned int rootMagicianPos;
+    const State<G>* current;
+
+    // fireDist[(type * fires + f) * MAP_SIZE + p]: fewest pushes for an ice
+    // block of the type (0: normal, 1: gold) at p to clear fire f alone
+    vector<uint16_t> fireDist;
+
+    // the states ever kept in the beam; those cut by the width may come
+    // back in a later layer
+    unordered_set<uint64_t> seen;
+    // states cut by the width, best first once sorted
+    vector<Candidate> reserve;
+    size_t exploredStateCount_ = 0;
+    int exhaustedDepth_ = -1;
+    vector<BoardChange<G>> solution_;
+
+    void computeFireDistances();
+    int slideStatically(int pos, Direction d, bool isGoldIce,
+                        vector<int>& path, vector<int>& fires) const;
+    double heuristic() const;
+    void moveTo(const State<G>& s);
+    void buildSolution(const State<G>& goal);
+};
+
+#endif  // __QITS_BEAM_SEARCH_H
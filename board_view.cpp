@@ -1,9 +1,11 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
+#include <algorithm>
 #include "board_view.h"
 
-int BoardView::next[][static_cast<int>(Direction::_ALL)];
-bool BoardView::nextInited;
+static_assert(sizeof(ZOBRIST_VALUES) / sizeof(ZOBRIST_VALUES[0]) >= 5,
+              "zobrist_values.h is outdated; run `make zobrist_values`");
 
 static inline const uint64_t* getZobristValues(ObjectType t) {
     switch (t) {
@@ -11,25 +13,46 @@ static inline const uint64_t* getZobristValues(ObjectType t) {
     case ObjectType::FIRE:     return ZOBRIST_VALUES[1];
     case ObjectType::ICE_GOLD: return ZOBRIST_VALUES[2];
     case ObjectType::MAGICIAN: return ZOBRIST_VALUES[3];
+    case ObjectType::DISPENSER: return ZOBRIST_VALUES[4];
     default:
         __builtin_unreachable();
         return nullptr;
     }
 }
 
-BoardView::BoardView(const BoardConfiguration& config):
-    config(config), vis(), ts(0), hash(0) {
-    if (!nextInited) {
-        initNextTable();
-    }
-
+template <class G>
+BoardView<G>::BoardView(const BoardConfiguration<G>& config):
+    config(config), vis(), ts(0), hash(0), symHash(), symMagicianPos() {
     for (int i = 0; i < MAP_SIZE; i++) {
         iceToIndex[i] = -1;
         fireToIndex[i] = -1;
     }
+
+    if constexpr (G::SPECIAL_TILES) {
+        for (int i = 0; i < MAP_SIZE; i++) {
+            dispenserIce[i] = -1;
+            for (int d = 0; d < static_cast<int>(Direction::_ALL); d++) {
+                int peek = next[i][d];
+                slide[i][d] = {static_cast<Pos>(peek), static_cast<unsigned char>(d)};
+                if (peek >= 0 && isArrow(config.map[peek])) {
+                    slide[i][d].dir = static_cast<unsigned char>(arrowDirection(config.map[peek]));
+                }
+            }
+        }
+    }
+
+    typename G::PatType completedPat{};
+    for (size_t i = 0; i < config.fires.size(); i++) {
+        completedPat[i] = 1;
+    }
+    if (patdb.queryByPat(completedPat) != 1) {
+        eprintf("Pattern database is corrupted. This should not happen.\n");
+        abort();
+    }
 }
 
-void BoardView::print() {
+template <class G>
+void BoardView<G>::print() {
     printf("   +");
     for (int j = 0; j < MAP_W; j++) {
         printf("-%02d-", j);
@@ -45,9 +68,13 @@ void BoardView::print() {
                 printf("%c%2d ", config.iceType[iceToIndex[p]] ? '$' : '%', iceToIndex[p]);
                 // note that the underlying cell may have a non-EMPTY ObjectType
                 // e.g. recycler
-            } else if (val == BoardView::WALL) {
+            } else if (isDispenser(p) && pushableIceAt(p) >= 0) {
+                printf("+%2d ", pushableIceAt(p));
+            } else if (isArrow(config.map[p])) {
+                printf(" %c%c ", objectTypeToRepr(config.map[p]), val == ts ? '.' : ' ');
+            } else if (val == BoardView<G>::WALL) {
                 printf("  X ");
-            } else if (val == BoardView::MARKED) {
+            } else if (val == BoardView<G>::MARKED) {
                 if (fireToIndex[p] >= 0) {
                     printf("*%2d ", fireToIndex[p]);
                 } else {
@@ -71,14 +98,44 @@ void BoardView::print() {
     printf("Magician position: %d\n", magicianPos);
 }
 
-void BoardView::updateHash(int pos, ObjectType t) {
+template <class G>
+void BoardView<G>::updateHash(int pos, ObjectType t) {
     // fprintf(stderr, "hash upd tp=%zd pos=%d\n",
     //         (getZobristValues(t) - ZOBRIST_VALUES[0]) / MAP_SIZE,
     //         pos);
-    hash ^= getZobristValues(t)[pos];
+    const uint64_t* values = getZobristValues(t);
+    hash ^= values[pos];
+
+    if (t != ObjectType::MAGICIAN) {
+        for (size_t i = 0; i < config.symmetries.size(); i++) {
+            symHash[i] ^= values[config.symmetries[i].cell[pos]];
+        }
+    }
+}
+
+template <class G>
+uint64_t BoardView<G>::canonicalHash() const {
+    const uint64_t* values = getZobristValues(ObjectType::MAGICIAN);
+    uint64_t h = hash;
+    for (size_t i = 0; i < config.symmetries.size(); i++) {
+        h = min(h, symHash[i] ^ values[symMagicianPos[i]]);
+    }
+    return h;
+}
+
+template <class G>
+uint64_t BoardView<G>::layoutHash() const {
+    return hash ^ getZobristValues(ObjectType::MAGICIAN)[magicianPos];
+}
+
+template <class G>
+bool BoardView<G>::isSymmetricUnder(size_t i) const {
+    return symHash[i] == layoutHash() &&
+           symMagicianPos[i] == magicianPos;
 }
 
-bool BoardView::verifyHash() const {
+template <class G>
+bool BoardView<G>::verifyHash() const {
     uint64_t test = 0;
     for (int i = 0; i < MAP_SIZE; i++) {
         if (iceToIndex[i] >= 0) {
@@ -89,14 +146,24 @@ bool BoardView::verifyHash() const {
         }
     }
 
+    if constexpr (G::SPECIAL_TILES) {
+        for (auto& disp: config.dispensers) {
+            if (dispenserIce[disp.first] >= 0) {
+                test ^= getZobristValues(ObjectType::DISPENSER)[disp.first];
+            }
+        }
+    }
+
     test ^= getZobristValues(ObjectType::MAGICIAN)[magicianPos];
 
     return hash == test;
 }
 
-void BoardView::moveIceBlock(int idx, int from, int to) {
+template <class G>
+void BoardView<G>::moveIceBlock(int idx, int from, int to) {
     // TODO: check if this application is legitimate
-    assert(from != to);
+    // (from == to is, for an ice block that arrows turned back against
+    // the magician, and then does nothing)
 
     ObjectType iceType = config.getIceTypeAtIndex(idx);
 
@@ -113,12 +180,41 @@ void BoardView::moveIceBlock(int idx, int from, int to) {
     // else it is elimiated from map, do nothing
 }
 
-void BoardView::apply(const BoardChange& change) {
+// move the ice block of a state into place, releasing it from its
+// dispenser if it was pushed out of one
+template <class G>
+void BoardView<G>::applyMove(const State<G>& s) {
+    if constexpr (G::SPECIAL_TILES) {
+        if (isDispenser(s.oldPosition)) {
+            dispenserIce[s.oldPosition] = -1;
+            updateHash(s.oldPosition, ObjectType::DISPENSER);
+            moveIceBlock(s.movedIceIndex, -1, s.newPosition);
+            return;
+        }
+    }
+    moveIceBlock(s.movedIceIndex, s.oldPosition, s.newPosition);
+}
+
+template <class G>
+void BoardView<G>::unapplyMove(const State<G>& s) {
+    if constexpr (G::SPECIAL_TILES) {
+        if (isDispenser(s.oldPosition)) {
+            moveIceBlock(s.movedIceIndex, s.newPosition, -1);
+            dispenserIce[s.oldPosition] = s.movedIceIndex;
+            updateHash(s.oldPosition, ObjectType::DISPENSER);
+            return;
+        }
+    }
+    moveIceBlock(s.movedIceIndex, s.newPosition, s.oldPosition);
+}
+
+template <class G>
+void BoardView<G>::apply(const BoardChange<G>& change) {
     auto& s = change.state;
     assert(s.oldPosition >= 0 &&
-           iceToIndex[s.oldPosition] >= 0);
+           pushableIceAt(s.oldPosition) >= 0);
 
-    moveIceBlock(s.movedIceIndex, s.oldPosition, s.newPosition);
+    applyMove(s);
 
     for (auto fpos: change.posClearedFires) {
         // TODO: check if the cell is fire
@@ -127,18 +223,19 @@ void BoardView::apply(const BoardChange& change) {
     }
 }
 
-void BoardView::unapply(const BoardChange& change) {
+template <class G>
+void BoardView<G>::unapply(const BoardChange<G>& change) {
     // TODO: revert to previous state;
     // should find an alternative, "static allocated" way to
     // effectively iterate over fire positions
 
     auto& s = change.state;
     assert(s.oldPosition >= 0 &&
-           iceToIndex[s.oldPosition] < 0);
+           (iceToIndex[s.oldPosition] < 0 || s.newPosition == s.oldPosition));
 
     // FIXME: guard (s.newPosition < 0 || iceToIndex[s.newPosition] >= 0)
     // TODO: check consistency with parent state
-    moveIceBlock(s.movedIceIndex, s.newPosition, s.oldPosition);
+    unapplyMove(s);
 
     for (auto fpos: change.posClearedFires) {
         // TODO: check if the cell is fire
@@ -147,13 +244,14 @@ void BoardView::unapply(const BoardChange& change) {
     }
 }
 
-void BoardView::transit(const State& _s1, const State& _s2) {
+template <class G>
+void BoardView<G>::transit(const State<G>& _s1, const State<G>& _s2) {
     // TODO: find x = LCA(s1, s2), and restore ice blocks with
     // s1 -> x -> s2
-    const State* s1 = &_s1, * s2 = &_s2;
+    const State<G>* s1 = &_s1, * s2 = &_s2;
 
-    vector<const State*> backwardStates;
-    vector<const State*> forwardStates;
+    vector<const State<G>*> backwardStates;
+    vector<const State<G>*> forwardStates;
 
     if (s1->age > s2->age) {
         while (s1->age != s2->age) {
@@ -176,14 +274,14 @@ void BoardView::transit(const State& _s1, const State& _s2) {
 
     // s1 -> x
     for (auto s: backwardStates) {
-        moveIceBlock(s->movedIceIndex, s->newPosition, s->oldPosition);
+        unapplyMove(*s);
     }
     // x -> s2
-    for (auto s: forwardStates) {
-        moveIceBlock(s->movedIceIndex, s->oldPosition, s->newPosition);
+    for (auto it = forwardStates.rbegin(); it != forwardStates.rend(); ++it) {
+        applyMove(**it);
     }
 
-    PatType shouldBeCleared = _s2.getClearedFires();
+    auto shouldBeCleared = _s2.getClearedFires(patdb);
 
     // slow operation due to not storing concrete changes on fires
     for (size_t i = 0; i < config.fires.size(); i++) {
@@ -198,3 +296,210 @@ void BoardView::transit(const State& _s1, const State& _s2) {
     }
 }
 
+template <class G>
+bool pushIceBlock(BoardView<G>& bview, const State<G>& s, int pos, Direction d, BoardChange<G>& changes) {
+    using Pos = typename G::Pos;
+
+    int bidx = bview.pushableIceAt(pos);
+    bool isGoldIce = (bview.config.getIceTypeAtIndex(bidx) == ObjectType::ICE_GOLD);
+    State<G>& newState = changes.state;
+
+    // the storage of `changes` may be reused by the caller
+    newState = s;
+    changes.posClearedFires.clear();
+
+    newState.previous = const_cast<State<G>*>(&s);
+    newState.age = s.age + 1;
+    newState.movedIceIndex = bidx;
+    newState.oldPosition = static_cast<Pos>(pos);
+
+    auto npat = s.getClearedFires(bview.patdb);
+
+    Pos npos = newState.oldPosition, peek;
+    newState.magicianPos = bview.next[npos][static_cast<int>(oppositeDirection(d))];
+
+    // move onto peek; returns whether the ice block is still there
+    auto slideInto = [&](Pos peek) {
+        npos = peek;
+
+        if (bview.config.map[peek] == ObjectType::RECYCLER) {
+            if (!isGoldIce) {
+                npos = -1;
+                return false;
+            }
+        } else if (bview.isMarked(peek)) {
+            if (bview.fireToIndex[peek] >= 0) {
+                // encounter a FIRE; gold ice going round a loop of arrows
+                // may pass it again, and it is cleared only once
+                if (!npat[bview.fireToIndex[peek]]) {
+                    changes.posClearedFires.push_back(peek);
+                    npat[bview.fireToIndex[peek]] = 1;
+                }
+                if (!isGoldIce) {
+                    npos = -1;
+                    return false;
+                }
+            }
+        }
+        return true;
+    };
+
+    if constexpr (G::SPECIAL_TILES) {
+        // arrows only change the entries looked up. A slide that has not
+        // stopped after as many steps as there are (cell, direction) pairs
+        // has repeated one, so the ice block would go round a loop of
+        // arrows forever; such a push is not made at all.
+        int dir = static_cast<int>(d), steps;
+        for (steps = 0; steps < G::MAP_SIZE * static_cast<int>(Direction::_ALL); steps++) {
+            auto& step = bview.slide[npos][dir];
+            peek = step.pos;
+            // the cell the ice block comes from is empty by now, while
+            // arrows may turn it back onto the magician who pushed it
+            if (peek <= 0 || bview.isWall(peek) || peek == newState.magicianPos ||
+                (bview.iceToIndex[peek] >= 0 && peek != newState.oldPosition)) {
+                break;
+            }
+            dir = step.dir;
+            if (!slideInto(peek)) {
+                break;
+            }
+        }
+        if (steps == G::MAP_SIZE * static_cast<int>(Direction::_ALL)) {
+            return false;
+        }
+    } else {
+        while (peek = bview.next[npos][static_cast<int>(d)], peek > 0) {
+            if (bview.isWall(peek) || bview.iceToIndex[peek] >= 0) {
+                break;
+            }
+            if (!slideInto(peek)) {
+                break;
+            }
+        }
+    }
+
+    newState.newPosition = npos;
+    newState.setClearedFiresPat(bview.patdb, npat);
+    return true;
+}
+
+// check for reachability & set magician position on the view
+// to a normalized one. Beware of that side-effect!
+// pushables are encoded as "(idx << 8) + direction"
+template <class G>
+void exploreBoard(BoardView<G>& bview, vector<int>& pushables) {
+    const int MAP_W = G::MAP_W, MAP_SIZE = G::MAP_SIZE;
+
+    // BFS to explore reachable positions of magician
+    auto& vis = bview.vis;
+    bview.tick();
+
+    // re-allocating is slow
+    pushables.clear();
+    pushables.reserve(128);
+
+    unsigned int normalizedPosition = bview.magicianPos;
+    const auto& symmetries = bview.config.symmetries;
+    for (size_t i = 0; i < symmetries.size(); i++) {
+        bview.symMagicianPos[i] = symmetries[i].cell[bview.magicianPos];
+    }
+    // every cell is enqueued at most once
+    typename G::Pos q[MAP_SIZE];
+    int qhead = 0, qtail = 0;
+
+    vis[bview.magicianPos] = bview.ts;
+    q[qtail++] = bview.magicianPos;
+
+    while (qhead != qtail) {
+        int s = q[qhead++];
+
+        if (static_cast<unsigned int>(s) < normalizedPosition) {
+            normalizedPosition = s;
+        }
+        for (size_t i = 0; i < symmetries.size(); i++) {
+            unsigned int image = symmetries[i].cell[s];
+            if (image < bview.symMagicianPos[i]) {
+                bview.symMagicianPos[i] = image;
+            }
+        }
+
+        int t;
+        // left
+        if (t = s-1, s % MAP_W != 0) {
+            if (bview.canPushTo(t, Direction::LEFT)) {
+                pushables.push_back((t << 8) | static_cast<int>(Direction::LEFT));
+            } else if (bview.isFresh(t)) {
+                vis[t] = bview.ts;
+                q[qtail++] = t;
+            }
+        }
+        // right
+        if (t = s+1, t % MAP_W != 0) {
+            if (bview.canPushTo(t, Direction::RIGHT)) {
+                pushables.push_back((t << 8) | static_cast<int>(Direction::RIGHT));
+            } else if (bview.isFresh(t)) {
+                vis[t] = bview.ts;
+                q[qtail++] = t;
+            }
+        }
+        // up
+        if (t = s-MAP_W, t >= 0) {
+            if (bview.canPushTo(t, Direction::UP)) {
+                pushables.push_back((t << 8) | static_cast<int>(Direction::UP));
+            } else if (bview.isFresh(t)) {
+                vis[t] = bview.ts;
+                q[qtail++] = t;
+            }
+        }
+        // down
+        if (t = s+MAP_W, t < MAP_SIZE) {
+            if (bview.canPushTo(t, Direction::DOWN)) {
+                pushables.push_back((t << 8) | static_cast<int>(Direction::DOWN));
+            } else if (bview.isFresh(t)) {
+                vis[t] = bview.ts;
+                q[qtail++] = t;
+            }
+        }
+    }
+
+    bview.setMagicianPos(normalizedPosition);
+}
+
+// drop the moves of a symmetric board whose mirror image is also available,
+// keeping the smallest of each orbit
+template <class G>
+void pruneSymmetricMoves(const BoardView<G>& bview, vector<int>& pushables) {
+    const auto& symmetries = bview.config.symmetries;
+    vector<int> kept;
+
+    for (auto p: pushables) {
+        bool redundant = false;
+        for (size_t i = 0; i < symmetries.size() && !redundant; i++) {
+            auto& sym = symmetries[i];
+            if (!bview.isSymmetricUnder(i)) {
+                continue;
+            }
+            Direction d = sym.apply(static_cast<Direction>(p & 0xff));
+            int image = (sym.cell[p >> 8] << 8) | static_cast<int>(d);
+            redundant = image < p &&
+                find(pushables.begin(), pushables.end(), image) != pushables.end();
+        }
+        if (!redundant) {
+            kept.push_back(p);
+        }
+    }
+
+    pushables.swap(kept);
+}
+
+#define INSTANTIATE_BOARD_VIEW_VARIANT(W, H, S) \
+    template struct BoardView<Geometry<W, H, S>>; \
+    template bool pushIceBlock(BoardView<Geometry<W, H, S>>&, const State<Geometry<W, H, S>>&, \
+                               int, Direction, BoardChange<Geometry<W, H, S>>&); \
+    template void exploreBoard(BoardView<Geometry<W, H, S>>&, vector<int>&); \
+    template void pruneSymmetricMoves(const BoardView<Geometry<W, H, S>>&, vector<int>&);
+#define INSTANTIATE_BOARD_VIEW(W, H) \
+    INSTANTIATE_BOARD_VIEW_VARIANT(W, H, false) \
+    INSTANTIATE_BOARD_VIEW_VARIANT(W, H, true)
+
+QITS_GEOMETRIES(INSTANTIATE_BOARD_VIEW)
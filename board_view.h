@@ -1,24 +1,74 @@
 #ifndef __QITS_BOARD_VIEW_H
 #define __QITS_BOARD_VIEW_H
 
+#include <array>
 #include "qits.h"
 
+template <class G>
+using NextTable = array<array<typename G::Pos, static_cast<int>(Direction::_ALL)>, G::MAP_SIZE>;
+
+template <class G>
+constexpr NextTable<G> makeNextTable() {
+    const int MAP_W = G::MAP_W, MAP_H = G::MAP_H;
+    NextTable<G> next {};
+    for (int i = 0; i < MAP_H; i++) {
+        for (int j = 0; j < MAP_W; j++) {
+            int p = i * MAP_W + j;
+            next[p][static_cast<int>(Direction::UP)]    = (i != 0         ? p-MAP_W : -1);
+            next[p][static_cast<int>(Direction::DOWN)]  = (i != (MAP_H-1) ? p+MAP_W : -1);
+            next[p][static_cast<int>(Direction::LEFT)]  = (j != 0         ? p-1     : -1);
+            next[p][static_cast<int>(Direction::RIGHT)] = (j != (MAP_W-1) ? p+1     : -1);
+        }
+    }
+    return next;
+}
+
+template <class G>
 struct BoardView {
-    const BoardConfiguration& config;
-    char iceToIndex[MAP_SIZE];
-    char fireToIndex[MAP_SIZE];
+    static constexpr int MAP_W = G::MAP_W;
+    static constexpr int MAP_H = G::MAP_H;
+    static constexpr int MAP_SIZE = G::MAP_SIZE;
+    using Pos = typename G::Pos;
+
+    const BoardConfiguration<G>& config;
+    Pos iceToIndex[MAP_SIZE];
+    Pos fireToIndex[MAP_SIZE];
     unsigned int vis[MAP_SIZE];
     unsigned int ts;
     unsigned int magicianPos;
     uint64_t hash;
 
+    // the patterns of cleared fires of the states made on this view; the
+    // empty one is id 0 and the one with every fire cleared is id 1
+    PatternDatabase<typename G::PatType> patdb;
+
+    // the hash of the board without the magician, as seen through each
+    // of config.symmetries; the magician is normalized in its own way
+    // under each of them, tracked by exploreBoard()
+    uint64_t symHash[MAX_SYMMETRIES];
+    unsigned int symMagicianPos[MAX_SYMMETRIES];
+
+    // only allocated when G::SPECIAL_TILES is set
+    static constexpr int SPECIAL_SIZE = G::SPECIAL_TILES ? MAP_SIZE : 1;
+
+    // the index of the ice block still held by the dispenser at a cell, or -1
+    Pos dispenserIce[SPECIAL_SIZE];
+
+    // one step of a sliding ice block: the cell it enters from a cell in a
+    // direction, and the direction it heads to afterwards; arrows are
+    // resolved into this table once per floor
+    struct SlideStep {
+        Pos pos;
+        unsigned char dir;
+    };
+    SlideStep slide[SPECIAL_SIZE][static_cast<int>(Direction::_ALL)];
+
     static const unsigned int TS_MAX = 1 << 28;
     static const unsigned int WALL = -1024;
     static const unsigned int MARKED = -1023;
-    static int next[MAP_SIZE][static_cast<int>(Direction::_ALL)];
-    static bool nextInited;
+    static constexpr NextTable<G> next = makeNextTable<G>();
 
-    BoardView(const BoardConfiguration& config);
+    BoardView(const BoardConfiguration<G>& config);
 
     inline bool isWall(int pos) const { return vis[pos] == WALL; }
     inline bool isMarked(int pos) const { return vis[pos] == MARKED; }
@@ -38,9 +88,28 @@ struct BoardView {
     }
 
     void print();
+
+    inline bool isDispenser(int pos) const {
+        if constexpr (G::SPECIAL_TILES) {
+            return config.map[pos] == ObjectType::DISPENSER;
+        }
+        return false;
+    }
+
+    // the ice block that a push at pos would move, or -1
+    inline int pushableIceAt(int pos) const {
+        int idx = iceToIndex[pos];
+        if constexpr (G::SPECIAL_TILES) {
+            if (idx < 0) {
+                idx = dispenserIce[pos];
+            }
+        }
+        return idx;
+    }
+
     inline bool canPushTo(int pos, Direction d) {
-        // only an ice block can be pushed
-        if (iceToIndex[pos] < 0) {
+        // only an ice block (maybe one in a dispenser) can be pushed
+        if (pushableIceAt(pos) < 0) {
             return false;
         }
 
@@ -60,24 +129,58 @@ struct BoardView {
 
     void updateHash(int pos, ObjectType t);
     bool verifyHash() const;
+    // the smallest hash among the current board and its symmetric images;
+    // only meaningful right after exploreBoard()
+    uint64_t canonicalHash() const;
+    // the hash of the board with the magician taken out
+    uint64_t layoutHash() const;
+    // whether config.symmetries[i] maps the current board onto itself
+    bool isSymmetricUnder(size_t i) const;
     void moveIceBlock(int idx, int from, int to);
+    void applyMove(const State<G>& s);
+    void unapplyMove(const State<G>& s);
 
-    void apply(const BoardChange& change);
-    void unapply(const BoardChange& change);
-    void transit(const State& s1, const State& s2);
-
-    static void initNextTable() {
-        for (int i = 0; i < MAP_H; i++) {
-            for (int j = 0; j < MAP_W; j++) {
-                int p = i * MAP_W + j;
-                next[p][static_cast<int>(Direction::UP)]    = (i != 0         ? p-MAP_W : -1);
-                next[p][static_cast<int>(Direction::DOWN)]  = (i != (MAP_H-1) ? p+MAP_W : -1);
-                next[p][static_cast<int>(Direction::LEFT)]  = (j != 0         ? p-1     : -1);
-                next[p][static_cast<int>(Direction::RIGHT)] = (j != (MAP_W-1) ? p+1     : -1);
-            }
+    void apply(const BoardChange<G>& change);
+    void unapply(const BoardChange<G>& change);
+    void transit(const State<G>& s1, const State<G>& s2);
+};
+
+// returns false, leaving `changes` meaningless, if the ice block would go
+// round a loop of arrows forever; the push cannot be made then
+template <class G>
+bool pushIceBlock(BoardView<G>& bview, const State<G>& s, int pos, Direction d, BoardChange<G>& changes);
+
+template <class G>
+inline BoardChange<G> pushIceBlock(BoardView<G>& bview, const State<G>& s, int pos, Direction d) {
+    BoardChange<G> changes;
+    pushIceBlock(bview, s, pos, d, changes);
+    return changes;
+}
+
+// the direction the ice block of a state was pushed in, recovered from
+// where the magician stood
+template <class G>
+inline Direction pushDirection(const State<G>& s) {
+    for (int d = 0; d < static_cast<int>(Direction::_ALL); d++) {
+        Direction dir = static_cast<Direction>(d);
+        if (BoardView<G>::next[s.oldPosition][static_cast<int>(oppositeDirection(dir))] == s.magicianPos) {
+            return dir;
         }
-        nextInited = true;
     }
-};
+    __builtin_unreachable();
+    return Direction::_ALL;
+}
+
+template <class G>
+void exploreBoard(BoardView<G>& bview, vector<int>& pushables);
+template <class G>
+void pruneSymmetricMoves(const BoardView<G>& bview, vector<int>& pushables);
+
+template <class G>
+inline vector<int> exploreBoard(BoardView<G>& bview) {
+    vector<int> pushables;
+    exploreBoard(bview, pushables);
+    return pushables;
+}
 
 #endif  // __QITS_BOARD_VIEW_H
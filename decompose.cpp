@@ -0,0 +1,128 @@
+#include <numeric>
+#include "decompose.h"
+
+template <class G>
+using CellSet = bitset<G::MAP_SIZE>;
+
+// every cell an ice block starting at `start` could pass or stop at; a
+// slide into a loop of arrows is followed once round, as another block
+// may stop it anywhere on the loop
+template <class G>
+static CellSet<G> sweptCells(const BoardView<G>& bview, int start, bool isGoldIce) {
+    const int DIRS = static_cast<int>(Direction::_ALL);
+    auto& map = bview.config.map;
+    auto isStatic = [&](int p) {
+        return p <= 0 || map[p] == ObjectType::WALL || map[p] == ObjectType::DISPENSER;
+    };
+
+    CellSet<G> swept, rest;
+    vector<int> queue {start};
+    swept[start] = rest[start] = 1;
+
+    for (size_t head = 0; head < queue.size(); head++) {
+        int p = queue[head];
+        for (int d = 0; d < DIRS; d++) {
+            int behind = BoardView<G>::next[p][static_cast<int>(oppositeDirection(static_cast<Direction>(d)))];
+            if (isStatic(behind)) {
+                continue;
+            }
+
+            int npos = p, dir = d;
+            bitset<G::MAP_SIZE * DIRS> passed;
+            while (!passed[npos * DIRS + dir]) {
+                passed[npos * DIRS + dir] = 1;
+
+                int peek, ndir = dir;
+                if constexpr (G::SPECIAL_TILES) {
+                    peek = bview.slide[npos][dir].pos;
+                    ndir = bview.slide[npos][dir].dir;
+                } else {
+                    peek = BoardView<G>::next[npos][dir];
+                }
+                if (isStatic(peek)) {
+                    break;
+                }
+
+                npos = peek;
+                dir = ndir;
+                swept[npos] = 1;
+                if (map[npos] == ObjectType::RECYCLER && !isGoldIce) {
+                    break;
+                }
+                if (!rest[npos]) {
+                    rest[npos] = 1;
+                    queue.push_back(npos);
+                }
+            }
+        }
+    }
+
+    return swept;
+}
+
+template <class G>
+vector<Component> findIndependentComponents(const BoardView<G>& bview, const InitialState& init) {
+    auto& config = bview.config;
+    const size_t I = init.icePositions.size(), F = config.fires.size();
+
+    if (!config.dispensers.empty()) {
+        Component all;
+        all.ices.resize(I);
+        all.fires.resize(F);
+        iota(all.ices.begin(), all.ices.end(), 0);
+        iota(all.fires.begin(), all.fires.end(), 0);
+        return {all};
+    }
+
+    // ice blocks are nodes 0 .. I-1, fires I .. I+F-1
+    vector<int> parent(I + F);
+    iota(parent.begin(), parent.end(), 0);
+    auto find = [&](int x) {
+        while (parent[x] != x) {
+            x = parent[x] = parent[parent[x]];
+        }
+        return x;
+    };
+    auto unite = [&](int a, int b) {
+        parent[find(a)] = find(b);
+    };
+
+    vector<CellSet<G>> swept(I);
+    for (size_t i = 0; i < I; i++) {
+        swept[i] = sweptCells(bview, init.icePositions[i], config.iceType[i] == 1);
+        for (size_t f = 0; f < F; f++) {
+            if (swept[i][config.fires[f]]) {
+                unite(i, I + f);
+            }
+        }
+        for (size_t j = 0; j < i; j++) {
+            if ((swept[i] & swept[j]).any()) {
+                unite(i, j);
+            }
+        }
+    }
+
+    vector<Component> components;
+    vector<int> componentOf(I + F, -1);
+    for (size_t f = 0; f < F; f++) {
+        int root = find(I + f);
+        if (componentOf[root] < 0) {
+            componentOf[root] = components.size();
+            components.emplace_back();
+        }
+        components[componentOf[root]].fires.push_back(f);
+    }
+    for (size_t i = 0; i < I; i++) {
+        int root = find(i);
+        if (componentOf[root] >= 0) {
+            components[componentOf[root]].ices.push_back(i);
+        }
+    }
+
+    return components;
+}
+
+#define INSTANTIATE_DECOMPOSE(W, H) \
+    template vector<Component> findIndependentComponents(const BoardView<Geometry<W, H, false>>&, const InitialState&); \
+    template vector<Component> findIndependentComponents(const BoardView<Geometry<W, H, true>>&, const InitialState&);
+QITS_GEOMETRIES(INSTANTIATE_DECOMPOSE)
@@ -0,0 +1,24 @@
+#ifndef __QITS_DECOMPOSE_H
+#define __QITS_DECOMPOSE_H
+
+#include "qits.h"
+#include "board_view.h"
+
+// Ice blocks and the fires they may clear, cut off from every other such
+// group: no ice block of one group can slide over a cell where one of
+// another group may be, nor reach its fires. Only the magician, whose
+// walk may be blocked by either, is shared.
+struct Component {
+    vector<int> ices;   // indices into the initial state
+    vector<int> fires;  // indices into config.fires
+};
+
+// Partitions the fires of a floor into components by static slide
+// reachability: an ice block is assumed to stop anywhere along a slide,
+// as some other block may be in its way, and to slide over any fire, as
+// it may have been cleared. Ice blocks that can reach no fire are left
+// out. Floors with dispensers are not split.
+template <class G>
+vector<Component> findIndependentComponents(const BoardView<G>& bview, const InitialState& init);
+
+#endif  // __QITS_DECOMPOSE_H
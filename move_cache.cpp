@@ -0,0 +1,143 @@
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include "move_cache.h"
+
+template <class G>
+MoveCache<G>::MoveCache(size_t bytes) {
+    // a power of two number of sets, at least one
+    size_t setCount = 1;
+    while (setCount * 2 * sizeof(Set) <= bytes) {
+        setCount *= 2;
+    }
+    // calloc() only aligns to 16 bytes, but aligned_alloc() does not zero
+    // the memory, and clearing it would back every page
+    memory = calloc(setCount * sizeof(Set) + CACHE_LINE - 1, 1);
+    if (!memory) {
+        throw bad_alloc();
+    }
+    uintptr_t base = (reinterpret_cast<uintptr_t>(memory) + CACHE_LINE - 1) & ~uintptr_t(CACHE_LINE - 1);
+    sets = reinterpret_cast<Set*>(base);
+    setMask = setCount - 1;
+}
+
+template <class G>
+MoveCache<G>::~MoveCache() {
+    free(memory);
+}
+
+// the layout hash, mixed with where the magician stands unless regions
+// are told apart by their bitmaps
+template <class G>
+uint64_t MoveCache<G>::keyOf(const BoardView<G>& bview, unsigned int magicianPos) {
+    uint64_t layout = bview.layoutHash();
+    if constexpr (BY_REGION) {
+        return layout;
+    }
+    return layout ^ ((magicianPos + 1) * 0x9e3779b97f4a7c15ull);
+}
+
+template <class G>
+bool MoveCache<G>::matches(const Set& set, int way, uint64_t key, unsigned int magicianPos) {
+    const Entry& e = set.ways[way];
+    if (set.keys[way] != key || !e.used) {
+        return false;
+    }
+    if constexpr (BY_REGION) {
+        return (e.region[magicianPos >> 6] >> (magicianPos & 63)) & 1;
+    }
+    return true;
+}
+
+template <class G>
+bool MoveCache<G>::lookup(BoardView<G>& bview, vector<int>& pushables) {
+    uint64_t key = keyOf(bview, bview.magicianPos);
+    uint64_t setIndex = key & setMask;
+    Set& set = sets[setIndex];
+
+    shared_lock<shared_mutex> lock(locks[setIndex % STRIPES]);
+    for (int i = 0; i < WAYS; i++) {
+        if (!matches(set, i, key, bview.magicianPos)) {
+            continue;
+        }
+        Entry& e = set.ways[i];
+
+        __atomic_store_n(&e.referenced, 1, __ATOMIC_RELAXED);
+
+        pushables.clear();
+        for (int i = 0; i < e.count; i++) {
+            pushables.push_back(((e.pushables[i] >> 2) << 8) | (e.pushables[i] & 3));
+        }
+        for (size_t i = 0; i < bview.config.symmetries.size(); i++) {
+            bview.symMagicianPos[i] = e.symMagicianPos[i];
+        }
+        bview.setMagicianPos(e.magicianPos);
+
+        hits.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    misses.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+template <class G>
+void MoveCache<G>::insert(const BoardView<G>& bview, unsigned int magicianPos,
+                          const vector<int>& pushables) {
+    if (pushables.size() > MAX_PUSHABLES) {
+        return;
+    }
+
+    uint64_t key = keyOf(bview, magicianPos);
+    uint64_t setIndex = key & setMask;
+    Set& set = sets[setIndex];
+
+    unique_lock<shared_mutex> lock(locks[setIndex % STRIPES]);
+
+    // another thread may have got there first
+    for (int i = 0; i < WAYS; i++) {
+        if (matches(set, i, key, magicianPos)) {
+            return;
+        }
+    }
+
+    // the clock hand gives a second chance to every entry used since it
+    // last passed
+    Entry* victim;
+    while (true) {
+        int way = set.hand;
+        victim = &set.ways[way];
+        set.hand = (set.hand + 1) % WAYS;
+        if (!victim->used || !__atomic_exchange_n(&victim->referenced, 0, __ATOMIC_RELAXED)) {
+            set.keys[way] = key;
+            break;
+        }
+    }
+
+    victim->magicianPos = bview.magicianPos;
+    for (size_t i = 0; i < bview.config.symmetries.size(); i++) {
+        victim->symMagicianPos[i] = bview.symMagicianPos[i];
+    }
+    victim->used = true;
+    victim->count = pushables.size();
+    __atomic_store_n(&victim->referenced, 0, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < pushables.size(); i++) {
+        victim->pushables[i] = ((pushables[i] >> 8) << 2) | (pushables[i] & 0xff);
+    }
+
+    // the flood fill has just stamped the region with the current tick
+    if constexpr (BY_REGION) {
+        fill(begin(victim->region), end(victim->region), 0);
+        for (int p = 0; p < G::MAP_SIZE; p++) {
+            if (bview.vis[p] == bview.ts) {
+                victim->region[p >> 6] |= 1ull << (p & 63);
+            }
+        }
+    }
+}
+
+#define INSTANTIATE_MOVE_CACHE(W, H) \
+    template class MoveCache<Geometry<W, H, false>>; \
+    template class MoveCache<Geometry<W, H, true>>;
+QITS_GEOMETRIES(INSTANTIATE_MOVE_CACHE)
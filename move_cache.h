@@ -0,0 +1,117 @@
+#ifndef __QITS_MOVE_CACHE_H
+#define __QITS_MOVE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include "qits.h"
+#include "board_view.h"
+
+// A bounded cache of exploreBoard() results. The region the magician can
+// walk depends on the ice blocks, the fires not yet cleared and the
+// charged dispensers, i.e. on the hash of the board without the magician.
+// An entry holds one region of such a layout as a bitmap, so a magician
+// dropped anywhere in it hits, and a hit restores the normalized magician
+// and the pushables without a flood fill. On boards too large for the
+// bitmap the key is the full hash, with the magician where it stands.
+//
+// The table is set-associative with CLOCK (second chance) eviction in
+// each set. All zero bytes are an empty set, so the table is taken from
+// calloc() and only the pages written to are ever backed by memory; a
+// small floor does not pay for the whole table. A cache belongs to one
+// floor, as entries hold the magician under its symmetries, but it may
+// be shared between search threads: the sets are guarded by striped
+// reader-writer locks, and a hit only takes a shared lock, as the
+// reference bits are written with atomic builtins. Nothing in the table
+// is ever constructed, so it holds no atomic objects.
+template <class G>
+class MoveCache {
+public:
+    MoveCache(size_t bytes);
+    ~MoveCache();
+    MoveCache(const MoveCache&) = delete;
+    MoveCache& operator=(const MoveCache&) = delete;
+
+    // on a hit, normalizes the magician and fills in the pushables
+    bool lookup(BoardView<G>& bview, vector<int>& pushables);
+    // right after exploreBoard(); `magicianPos` is where the magician stood
+    // before it was normalized
+    void insert(const BoardView<G>& bview, unsigned int magicianPos, const vector<int>& pushables);
+
+    size_t capacity() const { return (setMask + 1) * WAYS; }
+    uint64_t hitCount() const { return hits.load(memory_order_relaxed); }
+    uint64_t missCount() const { return misses.load(memory_order_relaxed); }
+
+private:
+    static const int WAYS = 8;
+    static const int STRIPES = 64;
+    static const int CACHE_LINE = 64;
+    static constexpr bool BY_REGION = G::MAP_SIZE <= 512;
+    static constexpr int REGION_WORDS = BY_REGION ? (G::MAP_SIZE + 63) / 64 : 1;
+
+    // An entry takes whole cache lines, and the pushables get the room the
+    // other fields leave in them, but at least MIN_PUSHABLES; a region
+    // with more pushables than fit is not cached. This comes to 46 to 70
+    // with the geometries we have.
+    static const int MIN_PUSHABLES = 40;
+    static constexpr int FIXED_BYTES = 8 * REGION_WORDS + 2 * (1 + MAX_SYMMETRIES) + 3;
+    static constexpr int MAX_PUSHABLES =
+        ((FIXED_BYTES + 2 * MIN_PUSHABLES + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE - FIXED_BYTES) / 2;
+
+    // pushables are packed as (pos << 2) | direction
+    static_assert(G::MAP_SIZE <= (1 << 14), "cell indices do not fit the packing");
+    static_assert(MAX_PUSHABLES <= 255, "the count of pushables does not fit");
+
+    // no initializers: the table starts out as zero bytes
+    struct Entry {
+        // a bitmap, in words as bitset is not trivially constructible
+        uint64_t region[REGION_WORDS];
+        uint16_t magicianPos;
+        uint16_t symMagicianPos[MAX_SYMMETRIES];
+        uint16_t pushables[MAX_PUSHABLES];
+        bool used;
+        uint8_t count;
+        // only accessed through __atomic builtins
+        uint8_t referenced;
+    };
+    static_assert(sizeof(Entry) % CACHE_LINE == 0, "an entry does not fill its cache lines");
+
+    // the keys are kept apart, and the sets aligned, so that a lookup
+    // scans a single cache line
+    struct alignas(CACHE_LINE) Set {
+        uint64_t keys[WAYS];
+        Entry ways[WAYS];
+        uint8_t hand;
+    };
+    static_assert(sizeof(Set::keys) == CACHE_LINE, "the keys do not fill a cache line");
+    static_assert(is_trivially_default_constructible_v<Set>, "the table is not constructed");
+
+    // the block from calloc(), and the sets within it rounded up to a
+    // cache line
+    void* memory;
+    Set* sets;
+    uint64_t setMask;
+    shared_mutex locks[STRIPES];
+    atomic<uint64_t> hits {0}, misses {0};
+
+    static uint64_t keyOf(const BoardView<G>& bview, unsigned int magicianPos);
+    static bool matches(const Set& set, int way, uint64_t key, unsigned int magicianPos);
+};
+
+// exploreBoard() through a cache, which may be null
+template <class G>
+inline void exploreBoard(BoardView<G>& bview, vector<int>& pushables, MoveCache<G>* cache) {
+    if (!cache) {
+        exploreBoard(bview, pushables);
+        return;
+    }
+    if (cache->lookup(bview, pushables)) {
+        return;
+    }
+    unsigned int magicianPos = bview.magicianPos;
+    exploreBoard(bview, pushables);
+    cache->insert(bview, magicianPos, pushables);
+}
+
+#endif  // __QITS_MOVE_CACHE_H
@@ -1,13 +1,22 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
 #include <vector>
 #include <queue>
 #include <bitset>
 #include <unordered_set>
 #include <algorithm>
+#include <memory>
+#include <climits>
+#include <mutex>
+#include <thread>
 #include "qits.h"
 #include "board_view.h"
-
-PatternDatabase State::patdb{};
+#include "search_engine.h"
+#include "beam_search.h"
+#include "decompose.h"
 
 ObjectType reprToObjectType(char c) {
     switch (c) {
@@ -28,21 +37,23 @@ ObjectType reprToObjectType(char c) {
 }
 
 char objectTypeToRepr(ObjectType tp) {
-    const char idx2repr[] = " #%*-$@?<>^v+?";
+    const char idx2repr[] = " #%*-$@?^v<>+?";
     return idx2repr[static_cast<int>(tp)];
 }
 
-InitialState* findInitialState(const State& state) {
-    const State* s = &state;
+template <class G>
+InitialState* findInitialState(const State<G>& state) {
+    const State<G>* s = &state;
     while (s->age != 0) {
         s = s->previous;
     }
     return s->initial;
 }
 
-vector<int> icePositionsAtState(const State& state) {
-    vector<const State*> slist {};
-    const State* s = &state;
+template <class G>
+vector<int> icePositionsAtState(const State<G>& state) {
+    vector<const State<G>*> slist {};
+    const State<G>* s = &state;
 
     slist.reserve(s->age);
     while (s->age != 0) {
@@ -60,7 +71,9 @@ vector<int> icePositionsAtState(const State& state) {
     return poss;
 }
 
-void printConfiguration(BoardConfiguration& board, State& state) {
+template <class G>
+void printConfiguration(BoardConfiguration<G>& board, State<G>& state) {
+    const int MAP_W = G::MAP_W, MAP_H = G::MAP_H, MAP_SIZE = G::MAP_SIZE;
     char buf[MAP_SIZE] {};
 
     for (int i = 0; i < MAP_SIZE; i++) {
@@ -70,7 +83,9 @@ void printConfiguration(BoardConfiguration& board, State& state) {
     auto ices = icePositionsAtState(state);
 
     for (size_t i = 0; i < ices.size(); i++) {
-        buf[ices[i]] = board.iceType[i] ? '$' : '%';
+        if (ices[i] >= 0) {
+            buf[ices[i]] = board.iceType[i] ? '$' : '%';
+        }
     }
 
     buf[state.magicianPos] = '@';
@@ -93,150 +108,151 @@ void printConfiguration(BoardConfiguration& board, State& state) {
     }
 }
 
-BoardChange pushIceBlock(const BoardView& bview, const State& s, int pos, Direction d) {
-    int bidx = bview.iceToIndex[pos];
-    bool isGoldIce = (bview.config.getIceTypeAtIndex(bidx) == ObjectType::ICE_GOLD);
-    BoardChange changes{s};
-    State& newState = changes.state;
-
-    newState.previous = const_cast<State*>(&s);
-    newState.age = s.age + 1;
-    newState.movedIceIndex = bidx;
-    newState.oldPosition = static_cast<short int>(pos);
+// a floor as written in its text file, before cropping
+struct RawFloor {
+    vector<string> lines;
+    int width = 0;
 
-    PatType npat = s.getClearedFires();
+    // the area beyond the text acts as walls, and short lines are padded
+    // with empty cells
+    ObjectType at(int i, int j) const {
+        if (i < 0 || i >= static_cast<int>(lines.size()) || j < 0 || j >= width) {
+            return ObjectType::WALL;
+        }
+        if (j >= static_cast<int>(lines[i].size())) {
+            return ObjectType::EMPTY;
+        }
+        return reprToObjectType(lines[i][j]);
+    }
+};
 
-    short int npos = newState.oldPosition, peek;
-    newState.magicianPos = static_cast<short int>(
-        bview.next[npos][static_cast<int>(oppositeDirection(d))]);
+// the floor ends at the first empty line or at EOF
+bool readFloorFileFromStdin(RawFloor& raw) {
+    bool hasMagician = false;
 
-    while (peek = bview.next[npos][static_cast<int>(d)], peek > 0) {
-        if (bview.isWall(peek) || bview.iceToIndex[peek] >= 0) {
+    // lines of any length, so that floors of any size can be cropped
+    string line;
+    while (getline(cin, line)) {
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty()) {
             break;
         }
 
-        npos = peek;
-
-        if (bview.config.map[peek] == ObjectType::RECYCLER) {
-            if (!isGoldIce) {
-                npos = -1;
-                break;
+        int i = raw.lines.size();
+        for (size_t j = 0; j < line.size(); j++) {
+            char c = line[j];
+            ObjectType tp = reprToObjectType(c);
+            if (tp == ObjectType::UNKNOWN) {
+                eprintf("Line %d col %zd: Unknown char '%c'\n", i + 1, j + 1, c);
+                return false;
             }
-        } else if (bview.isMarked(peek)) {
-            if (bview.fireToIndex[peek] >= 0) {
-                // encounter a FIRE
-                changes.posClearedFires.push_back(peek);
-                npat[bview.fireToIndex[peek]] = 1;
-                if (!isGoldIce) {
-                    npos = -1;
-                    break;
+
+            if (tp == ObjectType::MAGICIAN) {
+                if (hasMagician) {
+                    eprintf("Line %d col %zd: Duplicated magician\n", i + 1, j + 1);
+                    return false;
                 }
+                hasMagician = true;
             }
         }
+
+        raw.lines.push_back(line);
+        raw.width = max(raw.width, static_cast<int>(line.size()));
     }
 
-    newState.newPosition = npos;
-    newState.setClearedFiresPat(npat);
+    if (!hasMagician) {
+        eprintf("No magician on the floor\n");
+        return false;
+    }
 
-    return changes;
+    return true;
 }
 
-// check for reachability & set magician position on the view
-// to a normalized one. Beware of that side-effect!
-// pushables are encoded as "(idx << 8) + direction"
-vector<int> exploreBoard(BoardView& bview) {
-    // BFS to explore reachable positions of magician
-    vector<int> pushables;
-    auto& vis = bview.vis;
-    bview.tick();
-
-    // re-allocating is slow
-    pushables.reserve(128);
-
-    unsigned int normalizedPosition = bview.magicianPos;
-    queue<int> q;
-
-    vis[bview.magicianPos] = bview.ts;
-    q.push(bview.magicianPos);
-
-    while (!q.empty()) {
-        int s = q.front();
-        q.pop();
-
-        if (static_cast<unsigned int>(s) < normalizedPosition) {
-            normalizedPosition = s;
-        }
-
-        int t;
-        // left
-        if (t = s-1, s % MAP_W != 0) {
-            if (bview.canPushTo(t, Direction::LEFT)) {
-                pushables.push_back((t << 8) | static_cast<int>(Direction::LEFT));
-            } else if (bview.isFresh(t)) {
-                vis[t] = bview.ts;
-                q.push(t);
-            }
-        }
-        // right
-        if (t = s+1, t % MAP_W != 0) {
-            if (bview.canPushTo(t, Direction::RIGHT)) {
-                pushables.push_back((t << 8) | static_cast<int>(Direction::RIGHT));
-            } else if (bview.isFresh(t)) {
-                vis[t] = bview.ts;
-                q.push(t);
-            }
-        }
-        // up
-        if (t = s-MAP_W, t >= 0) {
-            if (bview.canPushTo(t, Direction::UP)) {
-                pushables.push_back((t << 8) | static_cast<int>(Direction::UP));
-            } else if (bview.isFresh(t)) {
-                vis[t] = bview.ts;
-                q.push(t);
-            }
-        }
-        // down
-        if (t = s+MAP_W, t < MAP_SIZE) {
-            if (bview.canPushTo(t, Direction::DOWN)) {
-                pushables.push_back((t << 8) | static_cast<int>(Direction::DOWN));
-            } else if (bview.isFresh(t)) {
-                vis[t] = bview.ts;
-                q.push(t);
+// bounding box (inclusive) of the cells that matter: the non-wall region
+// connected to the magician or to any ice block, and every fire
+struct Window {
+    int top, left, bottom, right;
+
+    int height() const { return bottom - top + 1; }
+    int width() const { return right - left + 1; }
+};
+
+Window findActiveWindow(const RawFloor& raw) {
+    const int h = raw.lines.size(), w = raw.width;
+    Window win {h, w, -1, -1};
+    vector<bool> seen(h * w);
+    vector<int> stack;
+
+    auto extend = [&](int i, int j) {
+        win.top = min(win.top, i);
+        win.bottom = max(win.bottom, i);
+        win.left = min(win.left, j);
+        win.right = max(win.right, j);
+    };
+
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            ObjectType tp = raw.at(i, j);
+            if (tp == ObjectType::MAGICIAN || tp == ObjectType::ICE || tp == ObjectType::ICE_GOLD) {
+                stack.push_back(i * w + j);
+            } else if (tp == ObjectType::FIRE) {
+                extend(i, j);
             }
         }
     }
 
-    bview.setMagicianPos(normalizedPosition);
+    while (!stack.empty()) {
+        int p = stack.back();
+        stack.pop_back();
+        int i = p / w, j = p % w;
+        if (seen[p] || raw.at(i, j) == ObjectType::WALL) {
+            continue;
+        }
+        seen[p] = true;
+        extend(i, j);
 
-    return pushables;
-}
+        if (i != 0)     stack.push_back(p - w);
+        if (i != h - 1) stack.push_back(p + w);
+        if (j != 0)     stack.push_back(p - 1);
+        if (j != w - 1) stack.push_back(p + 1);
+    }
 
-bool readFloorFileFromStdin(BoardConfiguration& board, InitialState& state_init, State& state_root) {
-    for (int i = 0; i < MAP_H; i++) {
-        int idxBase = i * MAP_W;
-        int idx = idxBase;
+    return win;
+}
 
-        char c;
-        while (scanf("%c", &c) == 1 && c != '\n') {
-            if (idx - idxBase == MAP_W) {
-                continue;
-            }
-            ObjectType tp = reprToObjectType(c);
-            if (tp == ObjectType::UNKNOWN) {
-                eprintf("Line %d col %d: Unknown char '%c'\n", i + 1, idx - idxBase + 1, c);
-                return false;
+bool hasSpecialTiles(const RawFloor& raw, const Window& win) {
+    for (int i = win.top; i <= win.bottom; i++) {
+        for (int j = win.left; j <= win.right; j++) {
+            ObjectType tp = raw.at(i, j);
+            if (isArrow(tp) || tp == ObjectType::DISPENSER) {
+                return true;
             }
+        }
+    }
+    return false;
+}
 
-            // refuse to process unimplemented features
-            if (tp > ObjectType::_UNIMPLEMENTED) {
-                eprintf("Line %d col %d: Unimplemented element '%c'\n", i + 1, idx - idxBase + 1, c);
-                return false;
+// copy the active window, framed by walls, into the top-left corner of a
+// G-sized board; the rest of the board is filled with walls
+template <class G>
+void loadFloor(const RawFloor& raw, const Window& win,
+               BoardConfiguration<G>& board, InitialState& state_init, State<G>& state_root) {
+    for (int i = 0; i < G::MAP_H; i++) {
+        for (int j = 0; j < G::MAP_W; j++) {
+            int idx = i * G::MAP_W + j;
+            ObjectType tp = ObjectType::WALL;
+            if (i < win.height() + 2 && j < win.width() + 2) {
+                tp = raw.at(win.top - 1 + i, win.left - 1 + j);
             }
 
             // static blocks are mapped to board
             if (tp == ObjectType::WALL ||
                 tp == ObjectType::FIRE ||
-                tp == ObjectType::RECYCLER) {
+                tp == ObjectType::RECYCLER ||
+                tp == ObjectType::DISPENSER ||
+                isArrow(tp)) {
                 board.map[idx] = tp;
             }
 
@@ -255,190 +271,792 @@ bool readFloorFileFromStdin(BoardConfiguration& board, InitialState& state_init,
                 board.iceType.push_back(1);
                 state_init.icePositions.push_back(idx);
                 break;
+            case ObjectType::DISPENSER:
+                // the ice block it holds is not on the board yet
+                board.dispensers.push_back({idx, static_cast<int>(board.iceType.size())});
+                board.iceType.push_back(0);
+                state_init.icePositions.push_back(-1);
+                break;
             default: break;
             }
-
-            idx++;
         }
     }
+}
 
-    return true;
+// record every mirror/flip of the active window that preserves the static layout
+template <class G>
+void detectSymmetries(BoardConfiguration<G>& board, const Window& w) {
+    const int MAP_W = G::MAP_W, MAP_SIZE = G::MAP_SIZE;
+
+    for (int k = 1; k <= MAX_SYMMETRIES; k++) {
+        Symmetry<G> sym;
+        sym.mirror = k & 1;
+        sym.flip = k & 2;
+
+        for (int p = 0; p < MAP_SIZE; p++) {
+            sym.cell[p] = p;
+        }
+
+        bool preserved = true;
+        for (int i = w.top; i <= w.bottom; i++) {
+            for (int j = w.left; j <= w.right; j++) {
+                int si = sym.flip ? w.top + w.bottom - i : i;
+                int sj = sym.mirror ? w.left + w.right - j : j;
+                int p = i * MAP_W + j, q = si * MAP_W + sj;
+                sym.cell[p] = q;
+                if (board.map[q] != sym.apply(board.map[p])) {
+                    preserved = false;
+                }
+            }
+        }
+
+        if (preserved) {
+            board.symmetries.push_back(sym);
+        }
+    }
 }
 
-BoardView initBoardView(const BoardConfiguration& board, const InitialState& state_init) {
-    BoardView bview(board);
+template <class G>
+BoardView<G> initBoardView(const BoardConfiguration<G>& board, const InitialState& state_init) {
+    BoardView<G> bview(board);
 
-    for (int p = 0; p < MAP_SIZE; p++) {
+    for (int p = 0; p < G::MAP_SIZE; p++) {
         if (board.map[p] == ObjectType::RECYCLER) {
-            bview.vis[p] = BoardView::MARKED;
-        } else if (board.map[p] == ObjectType::WALL) {
-            bview.vis[p] = BoardView::WALL;
+            bview.vis[p] = BoardView<G>::MARKED;
+        } else if (board.map[p] == ObjectType::WALL ||
+                   board.map[p] == ObjectType::DISPENSER) {
+            bview.vis[p] = BoardView<G>::WALL;
         }
     }
 
     for (size_t i = 0; i < state_init.icePositions.size(); i++) {
         int p = state_init.icePositions[i];
+        if (p < 0) {
+            continue;
+        }
         bview.iceToIndex[p] = i;
         bview.updateHash(p, board.getIceTypeAtIndex(i));
     }
 
+    if constexpr (G::SPECIAL_TILES) {
+        for (auto& disp: board.dispensers) {
+            bview.dispenserIce[disp.first] = disp.second;
+            bview.updateHash(disp.first, ObjectType::DISPENSER);
+        }
+    }
+
     for (size_t i = 0; i < board.fires.size(); i++) {
         int p = board.fires[i];
         bview.fireToIndex[p] = i;
-        bview.vis[p] = BoardView::MARKED;
+        bview.vis[p] = BoardView<G>::MARKED;
         bview.updateHash(p, ObjectType::FIRE);
     }
 
     return bview;
 }
 
-static vector<int> pushablesCache[256];
-static unordered_set<uint64_t> stateHashTable;
-static vector<BoardChange> solution;
-static size_t exploredStateCount;
+// the view is left where it started
+template <class G>
+void printSteps(BoardView<G>& bview, const vector<BoardChange<G>>& steps) {
+    unsigned int startPos = bview.magicianPos;
+    for (auto& step: steps) {
+        exploreBoard(bview);
+        // undo the normalization
+        bview.setMagicianPos(step.state.magicianPos);
+        bview.print();
+        printf("STEP -->  ");
+        step.state.print(bview.patdb);
+        bview.apply(step);
+    }
+    exploreBoard(bview);
+    bview.print();
 
-bool dfs(BoardView& bview, const State& s, unsigned int depth, unsigned int depthLimit) {
-    if (exploredStateCount % 100000 == 0) {
-        printf("... %zd\n", exploredStateCount);
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
+        bview.unapply(*it);
     }
+    bview.setMagicianPos(startPos);
+}
 
-    if (s.clearedFiresPatId == 1) {
-        return true;
+// the deepest the exact search goes, in every mode
+static const unsigned int MAX_EXACT_DEPTH = 19;
+// the beam is not bound by the depth of the exact search
+static const unsigned int MAX_BEAM_DEPTH = 200;
+// the beam width of a portfolio when --beam is not given
+static const size_t PORTFOLIO_BEAM_WIDTH = 1000;
+
+// the searches a portfolio may race against each other
+enum class Strategy {
+    IDDFS,      // iterative deepening, as without a portfolio
+    ORDERED,    // iterative deepening, with fire clearing moves first
+    BFS,        // whole layers breadth-first; optimal, but memory hungry
+    BEAM,       // a beam search; fast, but no proof of optimality
+};
+static const int STRATEGY_COUNT = 4;
+static const char* const STRATEGY_NAMES[STRATEGY_COUNT] = {"iddfs", "ordered", "bfs", "beam"};
+
+struct Options {
+    SearchBudget budget;
+    // run a beam search first, and use its solution as an upper bound
+    bool beam = false;
+    size_t beamWidth = 0;
+    double weight = 1.0;
+    // the largest visited set, in bytes, to index by state rank
+    uint64_t visitedBudget = 256 << 20;
+    // the size of the exploreBoard() cache in bytes, 0 for none
+    uint64_t moveCacheSize = 64 << 20;
+    // solve independent parts of a floor one by one
+    bool decompose = true;
+    // searches to run side by side, each on its own thread; empty for the
+    // usual beam (if asked for) then iterative deepening
+    vector<Strategy> portfolio;
+};
+
+// a push, told by where the ice block is rather than by its index, so
+// that it means the same on a part of a floor as on the whole floor
+struct Push {
+    int pos;
+    Direction dir;
+};
+
+template <class G>
+vector<Push> toPushes(const vector<BoardChange<G>>& steps) {
+    vector<Push> pushes;
+    for (auto& step: steps) {
+        pushes.push_back({step.state.oldPosition, pushDirection(step.state)});
     }
+    return pushes;
+}
 
-    if (depth == depthLimit) {
-        return false;
+// solves the floor cut down to one part; if the search is stopped,
+// `pushes` is its best partial result
+template <class G>
+typename SearchEngine<G>::Status
+solvePart(const BoardConfiguration<G>& board, const InitialState& state_init,
+          int magicianPos, const Component& part, const Window& win, const Options& opts,
+          SearchBudget& budget, vector<Push>& pushes) {
+    // fires with no ice block to clear them
+    if (part.ices.empty() && !part.fires.empty()) {
+        return SearchEngine<G>::Status::EXHAUSTED;
     }
 
-    auto& pushables = pushablesCache[depth];
-    auto len = pushables.size();
+    BoardConfiguration<G> sub {};
+    InitialState sub_init {};
+    State<G> sub_root {.initial = &sub_init};
+    sub_root.magicianPos = magicianPos;
 
-    struct {
-        int idx;
-        Direction dir;
-        BoardChange change;
-    } changeList[len];
+    // the fires of other parts are as good as cleared
+    copy(board.map, board.map + G::MAP_SIZE, sub.map);
+    for (auto p: board.fires) {
+        sub.map[p] = ObjectType::EMPTY;
+    }
+    for (auto f: part.fires) {
+        sub.fires.push_back(board.fires[f]);
+        sub.map[board.fires[f]] = ObjectType::FIRE;
+    }
+    for (auto i: part.ices) {
+        sub.iceType.push_back(board.iceType[i]);
+        sub_init.icePositions.push_back(state_init.icePositions[i]);
+    }
+    detectSymmetries(sub, Window {1, 1, win.height(), win.width()});
 
-    for (size_t i = 0; i < len; i++) {
-        int idx = pushables[i] >> 8;
-        Direction dir = static_cast<Direction>(pushables[i] & 0xff);
-        changeList[i] = { idx, dir, pushIceBlock(bview, s, idx, dir) };
+    BoardView<G> bview = initBoardView(sub, sub_init);
+    bview.magicianPos = magicianPos;
+    bview.updateHash(bview.magicianPos, ObjectType::MAGICIAN);
+
+    StateRanker<G> ranker(sub);
+    bool ranked = ranker.size() <= opts.visitedBudget;
+    SearchEngine<G> engine(bview, sub_root, MAX_EXACT_DEPTH, ranked ? &ranker : nullptr);
+    engine.budget = budget;
+    // not the one of the whole floor: the entries hold the magician under
+    // the symmetries of the floor they were made on, and a part has its own
+    unique_ptr<MoveCache<G>> moveCache;
+    if (opts.moveCacheSize) {
+        moveCache = make_unique<MoveCache<G>>(opts.moveCacheSize);
     }
+    engine.moveCache = moveCache.get();
 
-    // prioritize a move that clears more fire
-    if (depth == depthLimit - 1) {
-        sort(changeList, changeList + len, [](auto& a, auto& b) -> bool {
-            size_t sa = a.change.posClearedFires.size();
-            size_t sb = b.change.posClearedFires.size();
-            if (sa != sb) return sa > sb;
-            // break the tie by their indicies
-            return a.change.state.movedIceIndex < b.change.state.movedIceIndex;
-        });
+    typename SearchEngine<G>::Status status;
+    while ((status = engine.step(1 << 16)) == SearchEngine<G>::Status::RUNNING) {
     }
+    budget = engine.budget;
 
-    for (size_t i = 0; i < len; i++) {
-        auto& change = changeList[i].change;
+    if (status == SearchEngine<G>::Status::SOLVED) {
+        pushes = toPushes(engine.solution());
+    } else if (status == SearchEngine<G>::Status::STOPPED) {
+        pushes = toPushes(engine.bestPartial().steps);
+    }
+    return status;
+}
 
-        unsigned int magicianPosOld = bview.magicianPos;
+// plays the pushes on the view, each of them only if the magician can
+// make it, and tells whether they all could be made and, unless
+// `partial`, cleared every fire; the view is left where it started
+template <class G>
+bool replayPushes(BoardView<G>& bview, const State<G>& root, const vector<Push>& pushes,
+                  vector<BoardChange<G>>& steps, bool partial = false) {
+    unsigned int startPos = bview.magicianPos;
+    vector<int> pushables;
+    const State<G>* s = &root;
+    bool valid = true;
+
+    steps.clear();
+    // the states are linked to each other
+    steps.reserve(pushes.size());
+    for (auto& push: pushes) {
+        exploreBoard(bview, pushables);
+        int code = (push.pos << 8) | static_cast<int>(push.dir);
+        if (find(pushables.begin(), pushables.end(), code) == pushables.end()) {
+            valid = false;
+            break;
+        }
+        steps.emplace_back();
+        if (!pushIceBlock(bview, *s, push.pos, push.dir, steps.back())) {
+            steps.pop_back();
+            valid = false;
+            break;
+        }
+        bview.apply(steps.back());
+        bview.setMagicianPos(steps.back().state.magicianPos);
+        s = &steps.back().state;
+    }
+    valid = valid && (partial || s->clearedFiresPatId == 1);
 
-        bview.apply(change);
-        bview.setMagicianPos(change.state.magicianPos);
-        pushablesCache[depth+1] = exploreBoard(bview);
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
+        bview.unapply(*it);
+    }
+    bview.setMagicianPos(startPos);
+    return valid;
+}
 
-        bool solved = false;
-        if (stateHashTable.find(bview.hash) == stateHashTable.end()) {
-            stateHashTable.insert(bview.hash);
-            solved = dfs(bview, change.state, depth + 1, depthLimit);
+// What the searches of a portfolio have found out about the floor. The
+// portfolio is done once the best solution is known to be optimal, and
+// then every search still running is cancelled.
+struct PortfolioBounds {
+    mutex lock;
+    // the shortest solution so far, and the strategy that found it
+    vector<Push> best;
+    int upper = INT_MAX;
+    Strategy finder;
+    // no solution within `lower` pushes
+    int lower = -1;
+    atomic<bool> done {false};
+
+    void offerSolution(const vector<Push>& pushes, Strategy by) {
+        lock_guard<mutex> guard(lock);
+        if (static_cast<int>(pushes.size()) < upper) {
+            best = pushes;
+            upper = pushes.size();
+            finder = by;
         }
+        update();
+    }
 
-        bview.unapply(change);
-        bview.setMagicianPos(magicianPosOld);
+    void offerLowerBound(int depth) {
+        lock_guard<mutex> guard(lock);
+        lower = max(lower, depth);
+        update();
+    }
+
+    // whether a search that finds solutions of `from` to `to` pushes may
+    // still find one shorter than the best and not ruled out
+    bool canImprove(unsigned int from, unsigned int to) {
+        lock_guard<mutex> guard(lock);
+        int shortest = max(static_cast<int>(from), lower + 1);
+        return shortest < upper && shortest <= static_cast<int>(to);
+    }
 
+private:
+    void update() {
+        if (lower + 1 >= upper) {
+            done.store(true, memory_order_relaxed);
+        }
+    }
+};
+
+// how one search of a portfolio went
+struct PortfolioReport {
+    const char* outcome = "";
+    uint64_t nodes = 0;
+    // the limit it ran into, if any
+    const char* stopReason = nullptr;
+    // the best partial result, from iterative deepening only
+    unsigned int partialFires = 0;
+    vector<Push> partial;
+};
+
+// runs one search of a portfolio on its own copy of the view; everything
+// else is shared, and only read, except for the move cache and the bounds
+template <class G>
+void runStrategy(Strategy strategy, BoardView<G> bview, const State<G>& root, unsigned int maxDepth,
+                 const StateRanker<G>* ranker, MoveCache<G>* moveCache, const Options& opts,
+                 SearchBudget budget, PortfolioBounds& bounds, PortfolioReport& report) {
+    using Engine = SearchEngine<G>;
+
+    budget.setCancelFlag(&bounds.done);
+    uint64_t startNodes = budget.nodes;
+
+    if (strategy == Strategy::IDDFS || strategy == Strategy::ORDERED) {
+        Engine engine(bview, root, maxDepth, ranker);
+        engine.budget = budget;
+        engine.verbose = false;
+        engine.moveCache = moveCache;
+        engine.orderMoves = (strategy == Strategy::ORDERED);
+
+        typename Engine::Status status;
+        while ((status = engine.step(1 << 16)) == Engine::Status::RUNNING) {
+            bounds.offerLowerBound(engine.exhaustedDepth());
+        }
+        // a solution is found right after the limit below it is exhausted
+        bounds.offerLowerBound(engine.exhaustedDepth());
+
+        if (status == Engine::Status::SOLVED) {
+            bounds.offerSolution(toPushes(engine.solution()), strategy);
+            report.outcome = "solved";
+        } else if (status == Engine::Status::EXHAUSTED) {
+            report.outcome = "exhausted";
+        } else {
+            report.outcome = "stopped";
+            report.partialFires = engine.bestPartial().clearedFires;
+            report.partial = toPushes(engine.bestPartial().steps);
+        }
+        budget = engine.budget;
+    } else {
+        bool bfs = (strategy == Strategy::BFS);
+        size_t width = bfs ? 0 : opts.beam ? opts.beamWidth : PORTFOLIO_BEAM_WIDTH;
+        unsigned int deepest = bfs ? maxDepth : MAX_BEAM_DEPTH;
+        BeamSearch<G> beam(bview, root, width, bfs ? 0 : opts.weight, deepest);
+        beam.budget = budget;
+        beam.verbose = false;
+        beam.moveCache = moveCache;
+        // the layers are shared as they are done, and once the others have
+        // left this search nothing to find, it is as good as cancelled
+        bool futile = false;
+        beam.onLayer = [&](int exhausted, unsigned int next) {
+            // only layers expanded in full count towards the lower bound, so
+            // it holds for a beam too; `next` covers the states the beam
+            // took back from its reserve
+            bounds.offerLowerBound(exhausted);
+            futile = !bounds.canImprove(next, deepest);
+            return !futile;
+        };
+
+        bool solved = beam.run();
+        bounds.offerLowerBound(beam.exhaustedDepth());
         if (solved) {
-            solution.push_back(move(change));
-            return true;
+            bounds.offerSolution(toPushes(beam.solution()), strategy);
         }
+        report.outcome = solved ? "solved" : beam.budget.stopped ? "stopped" :
+                         futile ? "cancelled" : "exhausted";
+        budget = beam.budget;
     }
 
-    return false;
+    report.nodes = budget.nodes - startNodes;
+    // the portfolio may be done by now, while this search stopped on its
+    // own limits before that
+    if (budget.stopped && strcmp(budget.stopReason, "cancelled") != 0) {
+        report.stopReason = budget.stopReason;
+    } else if (budget.stopped) {
+        report.outcome = "cancelled";
+    }
 }
 
-int main() {
-    BoardConfiguration board {};
-    InitialState state_init {};
-    State state_root {.initial = &state_init};
+// races the strategies of the portfolio, each on its own thread, and
+// prints the outcome like the usual search does
+template <class G>
+int solvePortfolio(const BoardConfiguration<G>& board, BoardView<G>& bview, const State<G>& root,
+                   MoveCache<G>* moveCache, const Options& opts, const SearchBudget& budget) {
+    const unsigned int maxDepth = MAX_EXACT_DEPTH;
+    const auto& strategies = opts.portfolio;
+
+    // every iterative deepening search keeps its own visited set
+    size_t exactSearches = count_if(strategies.begin(), strategies.end(), [](Strategy s) {
+        return s == Strategy::IDDFS || s == Strategy::ORDERED;
+    });
+    StateRanker<G> ranker(board);
+    bool ranked = exactSearches && ranker.size() <= opts.visitedBudget / exactSearches;
+    printf("Portfolio of %zd searches, visited sets %s\n", strategies.size(),
+           ranked ? "ranked" : "hashed");
+
+    PortfolioBounds bounds;
+    vector<PortfolioReport> reports(strategies.size());
+    vector<thread> threads;
+    for (size_t k = 0; k < strategies.size(); k++) {
+        threads.emplace_back(runStrategy<G>, strategies[k], bview, cref(root), maxDepth,
+                             ranked ? &ranker : nullptr, moveCache, cref(opts), budget,
+                             ref(bounds), ref(reports[k]));
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
 
-    bool success = readFloorFileFromStdin(board, state_init, state_root);
+    uint64_t nodes = 0;
+    const char* stopReason = nullptr;
+    const PortfolioReport* bestPartial = nullptr;
+    for (size_t k = 0; k < strategies.size(); k++) {
+        auto& r = reports[k];
+        printf("Portfolio %s: %s", STRATEGY_NAMES[static_cast<int>(strategies[k])], r.outcome);
+        if (r.stopReason) {
+            printf(" (%s)", r.stopReason);
+            stopReason = r.stopReason;
+        }
+        printf(", %" PRIu64 " nodes\n", r.nodes);
+        nodes += r.nodes;
 
-    if (!success) {
-        eprintf("Error loading from <stdin>.\n");
-        return 1;
+        if (!r.partial.empty() && (!bestPartial || r.partialFires > bestPartial->partialFires ||
+                                   (r.partialFires == bestPartial->partialFires &&
+                                    r.partial.size() < bestPartial->partial.size()))) {
+            bestPartial = &r;
+        }
+    }
+
+    vector<BoardChange<G>> steps;
+    if (bounds.upper != INT_MAX) {
+        if (!replayPushes(bview, root, bounds.best, steps)) {
+            eprintf("The portfolio solution does not replay. This should not happen.\n");
+            abort();
+        }
+        printf("====== SOLVED! ======\n");
+        printSteps(bview, steps);
+        printf("====== END OF SOLUTION ======\n");
+        printf("Found by %s; %s.\n", STRATEGY_NAMES[static_cast<int>(bounds.finder)],
+               bounds.done ? "no shorter solution exists" : "a shorter solution may exist");
+    } else if (stopReason) {
+        printf("Search stopped: %s after %" PRIu64 " nodes.\n", stopReason, nodes);
+        if (bestPartial) {
+            replayPushes(bview, root, bestPartial->partial, steps, true);
+            printf("====== BEST PARTIAL RESULT: %u/%zd fires cleared in %zd pushes ======\n",
+                   bestPartial->partialFires, board.fires.size(), steps.size());
+            printSteps(bview, steps);
+            printf("====== END OF PARTIAL RESULT ======\n");
+        }
+    } else {
+        printf("No solution.\n");
+    }
+
+    if (moveCache) {
+        printf("Move cache: %" PRIu64 " hits, %" PRIu64 " misses\n",
+               moveCache->hitCount(), moveCache->missCount());
     }
 
+    if (bounds.lower >= 0) {
+        printf("Proven lower bound: no solution within %d pushes.\n", bounds.lower);
+    }
+
+    return 0;
+}
+
+template <class G>
+int solve(const RawFloor& raw, const Window& win, const Options& opts) {
+    using Engine = SearchEngine<G>;
+
+    BoardConfiguration<G> board {};
+    InitialState state_init {};
+    State<G> state_root {.initial = &state_init};
+
+    loadFloor(raw, win, board, state_init, state_root);
+
+    printf("Active window: %dx%d at line %d col %d, solved as %dx%d\n",
+           win.width(), win.height(), win.top + 1, win.left + 1, G::MAP_W, G::MAP_H);
     printConfiguration(board, state_root);
 
-    BoardView bview = initBoardView(board, state_init);
+    // in board coordinates, the window sits inside the wall frame
+    detectSymmetries(board, Window {1, 1, win.height(), win.width()});
+    printf("Symmetries:");
+    for (auto& sym: board.symmetries) {
+        printf(" %s", sym.mirror && sym.flip ? "rotation" : sym.mirror ? "mirror" : "flip");
+    }
+    printf(board.symmetries.empty() ? " none\n" : "\n");
+
+    BoardView<G> bview = initBoardView(board, state_init);
     bview.magicianPos = state_root.magicianPos;
     bview.updateHash(bview.magicianPos, ObjectType::MAGICIAN);
 
-    PatType completedPat{};
+    SearchBudget budget = opts.budget;
+    unique_ptr<MoveCache<G>> moveCache;
+    if (opts.moveCacheSize) {
+        moveCache = make_unique<MoveCache<G>>(opts.moveCacheSize);
+    }
 
-    for (size_t i = 0; i < board.fires.size(); i++) {
-        completedPat[i] = 1;
+    // Each part is a relaxation of the whole floor, the others being gone,
+    // so the sum of their optimal lengths is a lower bound. If their
+    // solutions one after another also solve the whole floor, that is an
+    // optimal solution.
+    vector<vector<Push>> partPushes;
+    if (opts.decompose) {
+        auto parts = findIndependentComponents(bview, state_init);
+        if (parts.size() > 1) {
+            printf("Independent parts: %zd\n", parts.size());
+            for (size_t k = 0; k < parts.size(); k++) {
+                printf("====== PART %zd: %zd ice blocks, %zd fires ======\n",
+                       k + 1, parts[k].ices.size(), parts[k].fires.size());
+                partPushes.emplace_back();
+                auto status = solvePart(board, state_init, state_root.magicianPos, parts[k],
+                                        win, opts, budget, partPushes.back());
+                if (status == Engine::Status::STOPPED) {
+                    // the whole floor would be searched with nothing left of
+                    // the budget, so the parts so far are the result
+                    printf("Search stopped: %s after %" PRIu64 " nodes.\n",
+                           budget.stopReason, budget.nodes);
+                    vector<Push> pushes;
+                    for (auto& part: partPushes) {
+                        pushes.insert(pushes.end(), part.begin(), part.end());
+                    }
+                    // up to where the parts interfere, if they do
+                    vector<BoardChange<G>> steps;
+                    replayPushes(bview, state_root, pushes, steps, true);
+                    size_t cleared = 0;
+                    for (auto& step: steps) {
+                        cleared += step.posClearedFires.size();
+                    }
+                    printf("====== BEST PARTIAL RESULT: %zd/%zd fires cleared in %zd pushes ======\n",
+                           cleared, board.fires.size(), steps.size());
+                    printSteps(bview, steps);
+                    printf("====== END OF PARTIAL RESULT ======\n");
+                    return 0;
+                }
+                if (status == Engine::Status::EXHAUSTED) {
+                    // nothing fits in the part, so nothing fits in the whole
+                    // floor either
+                    printf("Part %zd has no solution.\n", k + 1);
+                    printf("No solution.\n");
+                    printf("Proven lower bound: no solution within %u pushes.\n", MAX_EXACT_DEPTH);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    if (!partPushes.empty()) {
+        // try the parts in order, then backwards
+        for (int attempt = 0; attempt < 2; attempt++) {
+            vector<Push> pushes;
+            for (auto& part: partPushes) {
+                pushes.insert(pushes.end(), part.begin(), part.end());
+            }
+            vector<BoardChange<G>> steps;
+            if (replayPushes(bview, state_root, pushes, steps)) {
+                printf("====== SOLVED! ======\n");
+                printSteps(bview, steps);
+                printf("====== END OF SOLUTION ======\n");
+                printf("Solved in %zd independent parts; no shorter solution exists.\n",
+                       partPushes.size());
+                return 0;
+            }
+            reverse(partPushes.begin(), partPushes.end());
+        }
+        printf("The parts interfere with each other; searching the whole floor.\n");
     }
 
-    if (State::patdb.queryByPat(completedPat) != 1) {
-        eprintf("Pattern database is corrupted. This should not happen.\n");
-        abort();
+    if (!opts.portfolio.empty()) {
+        return solvePortfolio(board, bview, state_root, moveCache.get(), opts, budget);
     }
 
-    pushablesCache[0] = exploreBoard(bview);
-    bview.print();
+    unsigned int maxDepth = MAX_EXACT_DEPTH;
+    vector<BoardChange<G>> beamSolution;
+    bool hasBeamSolution = false;
+
+    if (opts.beam) {
+        BeamSearch<G> beam(bview, state_root, opts.beamWidth, opts.weight, MAX_BEAM_DEPTH);
+        beam.budget = budget;
+        beam.moveCache = moveCache.get();
+        if (beam.run()) {
+            hasBeamSolution = true;
+            beamSolution = beam.solution();
+            printf("====== BEAM SOLUTION: %zd pushes, %zd states explored ======\n",
+                   beamSolution.size(), beam.exploredStateCount());
+            printSteps(bview, beamSolution);
+            printf("====== END OF BEAM SOLUTION ======\n");
+        } else {
+            printf("Beam search found no solution within %u pushes (%s).\n", MAX_BEAM_DEPTH,
+                   beam.budget.stopped ? beam.budget.stopReason : "beam exhausted");
+        }
+        // the node and time limits cover both searches
+        budget = beam.budget;
 
-    const uint64_t initialHash = bview.hash;
-    bool solved = false;
+        if (hasBeamSolution) {
+            if (beamSolution.empty()) {
+                return 0;
+            }
+            printf("Upper bound: %zd pushes; searching for a shorter solution.\n",
+                   beamSolution.size());
+            maxDepth = min<unsigned int>(maxDepth, beamSolution.size() - 1);
+        }
+    }
 
-    for (int lim = 0; lim < 20; lim++) {
-        printf("Trying %d steps...\n", lim);
+    // small state spaces are indexed by rank, with a byte per state
+    StateRanker<G> ranker(board);
+    bool ranked = ranker.size() <= opts.visitedBudget;
+    if (ranked) {
+        printf("Visited set: ranked, %" PRIu64 " states\n", ranker.size());
+    } else {
+        printf("Visited set: hashed\n");
+    }
 
-        exploredStateCount = 1;
-        stateHashTable.clear();
-        stateHashTable.insert(initialHash);
+    Engine engine(bview, state_root, maxDepth, ranked ? &ranker : nullptr);
+    engine.budget = budget;
+    engine.moveCache = moveCache.get();
+    bview.print();
 
-        solution.reserve(lim);
-        bool s = dfs(bview, state_root, 0, lim);
+    typename Engine::Status status;
+    while ((status = engine.step(1 << 16)) == Engine::Status::RUNNING) {
+    }
 
-        if (bview.hash != initialHash) {
-            eprintf("Hash mismatch!\n");
-            abort();
+    if (status == Engine::Status::STOPPED) {
+        printf("Search stopped: %s after %" PRIu64 " nodes.\n",
+               engine.budget.stopReason, engine.budget.nodes);
+    }
+
+    if (status == Engine::Status::SOLVED) {
+        printf("====== SOLVED! ======\n");
+        printSteps(bview, engine.solution());
+        printf("====== END OF SOLUTION ======\n");
+    } else if (hasBeamSolution) {
+        // nothing shorter was found, so the beam solution is the result
+        printf("====== SOLVED! ======\n");
+        printSteps(bview, beamSolution);
+        printf("====== END OF SOLUTION ======\n");
+        // the exact search may have stopped short of the beam solution,
+        // by the limits or by its own depth limit
+        if (status == Engine::Status::EXHAUSTED && maxDepth + 1 == beamSolution.size()) {
+            printf("No shorter solution: the beam solution is optimal.\n");
+        } else {
+            printf("The beam solution is not proven optimal.\n");
         }
+    } else if (status == Engine::Status::STOPPED) {
+        auto& partial = engine.bestPartial();
+        printf("====== BEST PARTIAL RESULT: %u/%zd fires cleared in %zd pushes ======\n",
+               partial.clearedFires, board.fires.size(), partial.steps.size());
+        printSteps(bview, partial.steps);
+        printf("====== END OF PARTIAL RESULT ======\n");
+    } else {
+        printf("No solution.\n");
+    }
+
+    if (moveCache) {
+        printf("Move cache: %" PRIu64 " hits, %" PRIu64 " misses\n",
+               moveCache->hitCount(), moveCache->missCount());
+    }
+
+    if (engine.exhaustedDepth() >= 0) {
+        printf("Proven lower bound: no solution within %d pushes.\n", engine.exhaustedDepth());
+    }
+
+    return 0;
+}
 
-        printf("Explored %zd states (%zd unique)\n", exploredStateCount, stateHashTable.size());
-        printf("Patterns generated = %zd\n", State::patdb.size());
+static void printUsage(const char* prog) {
+    eprintf("Usage: %s [--time-limit SECONDS] [--node-limit NODES]\n"
+            "       [--beam WIDTH] [--weight W] [--visited-budget MB]\n"
+            "       [--move-cache MB] [--no-decompose]\n"
+            "       [--portfolio all|iddfs,ordered,bfs,beam] < floor\n", prog);
+}
 
-        if (s) {
-            printf("====== SOLVED! ======\n");
+int main(int argc, char* argv[]) {
+    Options opts;
+    SearchBudget& budget = opts.budget;
 
-            reverse(solution.begin(), solution.end());
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--no-decompose") {
+            opts.decompose = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
 
-            for (auto& step: solution) {
-                exploreBoard(bview);
-                // undo the normalization
-                bview.setMagicianPos(step.state.magicianPos);
-                bview.print();
-                printf("STEP -->  ");
-                step.state.print();
-                bview.apply(step);
+        char* end;
+        const char* val = argv[++i];
+        if (arg == "--time-limit") {
+            double sec = strtod(val, &end);
+            if (*end != '\0' || sec <= 0) {
+                eprintf("Invalid time limit '%s'.\n", val);
+                return 1;
             }
-            exploreBoard(bview);
-            bview.print();
-            printf("====== END OF SOLUTION ======\n");
-            solved = true;
-            break;
+            budget.setTimeLimit(sec);
+        } else if (arg == "--node-limit") {
+            unsigned long long lim = strtoull(val, &end, 10);
+            if (*end != '\0' || lim == 0) {
+                eprintf("Invalid node limit '%s'.\n", val);
+                return 1;
+            }
+            budget.setNodeLimit(lim);
+        } else if (arg == "--beam") {
+            // 0 keeps every layer whole
+            unsigned long long width = strtoull(val, &end, 10);
+            if (*end != '\0' || *val == '-') {
+                eprintf("Invalid beam width '%s'.\n", val);
+                return 1;
+            }
+            opts.beam = true;
+            opts.beamWidth = width;
+        } else if (arg == "--weight") {
+            double weight = strtod(val, &end);
+            if (*end != '\0' || weight < 0) {
+                eprintf("Invalid weight '%s'.\n", val);
+                return 1;
+            }
+            opts.weight = weight;
+        } else if (arg == "--visited-budget") {
+            // 0 always hashes
+            unsigned long long mb = strtoull(val, &end, 10);
+            if (*end != '\0' || *val == '-' || mb > (UINT64_MAX >> 20)) {
+                eprintf("Invalid visited set budget '%s'.\n", val);
+                return 1;
+            }
+            opts.visitedBudget = mb << 20;
+        } else if (arg == "--move-cache") {
+            unsigned long long mb = strtoull(val, &end, 10);
+            if (*end != '\0' || *val == '-' || mb > (UINT64_MAX >> 20)) {
+                eprintf("Invalid move cache size '%s'.\n", val);
+                return 1;
+            }
+            opts.moveCacheSize = mb << 20;
+        } else if (arg == "--portfolio") {
+            string list = strcmp(val, "all") == 0 ? "iddfs,ordered,bfs,beam" : val;
+            opts.portfolio.clear();
+            for (size_t start = 0; start <= list.size(); ) {
+                size_t comma = min(list.find(',', start), list.size());
+                string name = list.substr(start, comma - start);
+                int k = 0;
+                while (k < STRATEGY_COUNT && name != STRATEGY_NAMES[k]) {
+                    k++;
+                }
+                if (k == STRATEGY_COUNT) {
+                    eprintf("Unknown search '%s' in portfolio.\n", name.c_str());
+                    return 1;
+                }
+                opts.portfolio.push_back(static_cast<Strategy>(k));
+                start = comma + 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
         }
     }
 
-    if (!solved) {
-        printf("No solution.\n");
+    RawFloor raw;
+
+    if (!readFloorFileFromStdin(raw)) {
+        eprintf("Error loading from <stdin>.\n");
+        return 1;
     }
+
+    Window win = findActiveWindow(raw);
+    // leave room for a frame of walls
+    int w = win.width() + 2, h = win.height() + 2;
+    bool special = hasSpecialTiles(raw, win);
+
+#define SOLVE_IF_FITS(W, H) \
+    if (w <= W && h <= H) { \
+        return special ? solve<Geometry<W, H, true>>(raw, win, opts) \
+                       : solve<Geometry<W, H, false>>(raw, win, opts); \
+    }
+    QITS_GEOMETRIES(SOLVE_IF_FITS)
+#undef SOLVE_IF_FITS
+
+    eprintf("Floor too large: the active area is %dx%d, at most %dx%d is supported.\n",
+            win.width(), win.height(), MAX_MAP_W - 2, MAX_MAP_H - 2);
+    return 1;
 }
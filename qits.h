@@ -1,9 +1,12 @@
 #ifndef __QITS_QITS_H
 #define __QITS_QITS_H
 
+#include <atomic>
 #include <cinttypes>
+#include <chrono>
 #include <vector>
 #include <bitset>
+#include <type_traits>
 #include <unordered_map>
 #include "zobrist_values.h"
 
@@ -12,11 +15,39 @@
 using namespace std;
 
 
-static const int MAP_W = 20;
-static const int MAP_H = 14;
-static const int MAP_SIZE = MAP_W * MAP_H;
-
-static const int MAX_FIRE = 256;
+// Floors are cropped to their active window (plus a wall border) and
+// solved with the smallest of these sizes that fits, in increasing area.
+#define QITS_GEOMETRIES(X) \
+    X(8, 8)   \
+    X(11, 11) \
+    X(16, 12) \
+    X(20, 14) \
+    X(32, 24) \
+    X(64, 64)
+
+static const int MAX_MAP_W = 64;
+static const int MAX_MAP_H = 64;
+
+// SPECIAL_TILES enables arrows and dispensers; floors without them are
+// solved by an instantiation that has no trace of them.
+template <int W, int H, bool SPECIAL = false>
+struct Geometry {
+    static constexpr int MAP_W = W;
+    static constexpr int MAP_H = H;
+    static constexpr int MAP_SIZE = W * H;
+    static constexpr bool SPECIAL_TILES = SPECIAL;
+
+    // every fire takes a cell
+    static constexpr int MAX_FIRE = MAP_SIZE;
+
+    // the narrowest type holding a cell index, an ice index or -1
+    using Pos = conditional_t<(MAP_SIZE < 128), int8_t, int16_t>;
+    using PatType = bitset<MAX_FIRE>;
+
+    static_assert(W <= MAX_MAP_W && H <= MAX_MAP_H, "geometry too large");
+    static_assert(sizeof(ZOBRIST_VALUES[0]) / sizeof(uint64_t) >= MAP_SIZE,
+                  "zobrist_values.h is too small; run `make zobrist_values`");
+};
 
 
 // FIXME: use X macros to tidy up these snippets
@@ -29,7 +60,7 @@ enum class ObjectType: unsigned char {
     ICE_GOLD,
     MAGICIAN,
 
-    _UNIMPLEMENTED,
+    _UNIMPLEMENTED,  // formerly the boundary of supported elements
     AR_UP,
     AR_DOWN,
     AR_LEFT,
@@ -60,16 +91,76 @@ static inline Direction oppositeDirection(Direction d) {
     return Direction::_ALL;
 }
 
+ObjectType reprToObjectType(char c);
+char objectTypeToRepr(ObjectType tp);
+
+static inline bool isArrow(ObjectType t) {
+    return t >= ObjectType::AR_UP && t <= ObjectType::AR_RIGHT;
+}
 
-using PatType = bitset<MAX_FIRE>;
+static inline Direction arrowDirection(ObjectType t) {
+    switch (t) {
+    case ObjectType::AR_UP:    return Direction::UP;
+    case ObjectType::AR_DOWN:  return Direction::DOWN;
+    case ObjectType::AR_LEFT:  return Direction::LEFT;
+    case ObjectType::AR_RIGHT: return Direction::RIGHT;
+    default: ;
+    }
+    __builtin_unreachable();
+    return Direction::_ALL;
+}
+
+static inline ObjectType arrowOfDirection(Direction d) {
+    switch (d) {
+    case Direction::UP:    return ObjectType::AR_UP;
+    case Direction::DOWN:  return ObjectType::AR_DOWN;
+    case Direction::LEFT:  return ObjectType::AR_LEFT;
+    case Direction::RIGHT: return ObjectType::AR_RIGHT;
+    default: ;
+    }
+    __builtin_unreachable();
+    return ObjectType::UNKNOWN;
+}
 
+
+// A non-trivial automorphism of the static layout, i.e. a mirror and/or
+// flip of the active window mapping walls, fires and recyclers onto
+// themselves. Cells outside the window are mapped to themselves.
+template <class G>
+struct Symmetry {
+    bool mirror;    // left <-> right
+    bool flip;      // up <-> down
+    typename G::Pos cell[G::MAP_SIZE];
+
+    inline Direction apply(Direction d) const {
+        switch (d) {
+        case Direction::UP:    return flip   ? Direction::DOWN  : d;
+        case Direction::DOWN:  return flip   ? Direction::UP    : d;
+        case Direction::LEFT:  return mirror ? Direction::RIGHT : d;
+        case Direction::RIGHT: return mirror ? Direction::LEFT  : d;
+        default: ;
+        }
+        __builtin_unreachable();
+        return Direction::_ALL;
+    }
+
+    // arrows turn along with the board
+    inline ObjectType apply(ObjectType t) const {
+        return isArrow(t) ? arrowOfDirection(apply(arrowDirection(t))) : t;
+    }
+};
+
+static const int MAX_SYMMETRIES = 3;
+
+
+template <class PatType>
 class PatternDatabase {
 public:
     PatternDatabase() {
         reset();
     }
 
-    auto size() { return id2pat.size(); }
+    auto size() const { return id2pat.size(); }
 
     void reset() {
         id2pat.clear();
@@ -91,7 +182,7 @@ public:
         return newId;
     }
 
-    PatType queryById(unsigned int id) {
+    PatType queryById(unsigned int id) const {
         if (id >= id2pat.size()) {
             return PatType(0);
         }
@@ -102,10 +193,14 @@ private:
     vector<PatType> id2pat;
 };
 
+template <class G>
 struct BoardConfiguration {
     vector<int> fires;
     vector<unsigned char> iceType;
-    ObjectType map[MAP_SIZE];
+    vector<Symmetry<G>> symmetries;
+    // (position, index of the ice block it holds)
+    vector<pair<int, int>> dispensers;
+    ObjectType map[G::MAP_SIZE];
 
     inline ObjectType getIceTypeAtIndex(int idx) const {
         return iceType[idx] == 1 ? ObjectType::ICE_GOLD : ObjectType::ICE;
@@ -114,10 +209,15 @@ struct BoardConfiguration {
 
 
 struct InitialState {
+    // -1 for ices still held by a dispenser
     vector<int> icePositions;
 };
 
+template <class G>
 struct State {
+    using Pos = typename G::Pos;
+    using PatType = typename G::PatType;
+
     union {
         InitialState* initial;  // if age == 0
         State* previous;        // otherwise
@@ -128,27 +228,26 @@ struct State {
 
     /* only meaningful when age > 0 */
     unsigned short int age;
-    short int movedIceIndex;
-    short int oldPosition;
-    short int newPosition;
+    Pos movedIceIndex;
+    Pos oldPosition;
+    Pos newPosition;
 
     unsigned int clearedFiresPatId;
 
-    static PatternDatabase patdb;
-
-    PatType getClearedFires() const {
-        auto kk = State::patdb.queryById(clearedFiresPatId);
-        return kk;
+    // the ids are those of the pattern database of the board view the
+    // state was made on
+    PatType getClearedFires(const PatternDatabase<PatType>& patdb) const {
+        return patdb.queryById(clearedFiresPatId);
     }
-    unsigned int setClearedFiresPat(PatType pat) {
-        unsigned int id = State::patdb.queryByPat(pat);
+    unsigned int setClearedFiresPat(PatternDatabase<PatType>& patdb, PatType pat) {
+        unsigned int id = patdb.queryByPat(pat);
         return (clearedFiresPatId = id);
     }
 
-    void print() const {
+    void print(const PatternDatabase<PatType>& patdb) const {
         printf("<State age=%d, pos=%d", age, magicianPos);
         if (age > 0) {
-            auto clearedFires = State::patdb.queryById(clearedFiresPatId);
+            auto clearedFires = patdb.queryById(clearedFiresPatId);
             printf(", #%d: %d -> %d, cf=[", movedIceIndex, oldPosition, newPosition);
             bool first = true;
             for (size_t i = 0; i < clearedFires.size(); i++) {
@@ -162,17 +261,109 @@ struct State {
     }
 };
 
+template <class G>
 struct BoardChange {
-    State state;
+    State<G> state;
 
     // often, it has only one element,
     // but golden ices make it uncertain QQ
     vector<int> posClearedFires;
 
-    BoardChange() : BoardChange(State()) {}
-    BoardChange(const State s) : state{s} {
+    BoardChange() : BoardChange(State<G>()) {}
+    BoardChange(const State<G> s) : state{s} {
         posClearedFires.reserve(1);
     }
 };
 
+// Cooperative limits on a search. exhausted() is called once per node, so
+// the common path is a single increment and compare; the clock, the node
+// limit and the cancel flag are only looked at when `nodes` reaches
+// `nextCheck`.
+struct SearchBudget {
+    using Clock = chrono::steady_clock;
+
+    static const uint64_t CLOCK_CHECK_INTERVAL = 1024;
+
+    uint64_t nodes = 0;
+    uint64_t nodeLimit = 0;     // 0 means unlimited
+    bool hasDeadline = false;
+    Clock::time_point deadline;
+
+    // set by another thread to stop this search
+    const atomic<bool>* cancelFlag = nullptr;
+
+    bool stopped = false;
+    const char* stopReason = nullptr;
+
+    SearchBudget() {
+        scheduleCheck();
+    }
+
+    void setNodeLimit(uint64_t limit) {
+        nodeLimit = limit;
+        scheduleCheck();
+    }
+
+    void setTimeLimit(double seconds) {
+        hasDeadline = true;
+        deadline = Clock::now() + chrono::duration_cast<Clock::duration>(
+            chrono::duration<double>(seconds));
+        scheduleCheck();
+    }
+
+    void setCancelFlag(const atomic<bool>* flag) {
+        cancelFlag = flag;
+        scheduleCheck();
+    }
+
+    bool cancelled() const {
+        return cancelFlag && cancelFlag->load(memory_order_relaxed);
+    }
+
+    inline bool exhausted() {
+        if (++nodes < nextCheck) {
+            return false;
+        }
+        return check();
+    }
+
+private:
+    uint64_t nextCheck;
+
+    void stop(const char* reason) {
+        stopped = true;
+        stopReason = reason;
+        nextCheck = 0;
+    }
+
+    void scheduleCheck() {
+        if (stopped) {
+            return;
+        }
+        nextCheck = UINT64_MAX;
+        if (hasDeadline || cancelFlag) {
+            nextCheck = (nodes | (CLOCK_CHECK_INTERVAL - 1)) + 1;
+        }
+        if (nodeLimit && nodeLimit < nextCheck) {
+            nextCheck = nodeLimit;
+        }
+    }
+
+    bool check() {
+        if (stopped) {
+            return true;
+        }
+        if (cancelled()) {
+            stop("cancelled");
+        } else if (nodeLimit && nodes >= nodeLimit) {
+            stop("node limit reached");
+        } else if (hasDeadline && Clock::now() >= deadline) {
+            stop("time limit reached");
+        } else {
+            scheduleCheck();
+        }
+        return stopped;
+    }
+};
+
 #endif  // __QITS_QITS_H
@@ -0,0 +1,182 @@
+"""Generates random floors for stress tests and scaling sweeps.
+
+A floor is a random open area (walls scattered with the given density,
+cut down to its largest connected region) with the magician, ice blocks
+and fires dropped on random cells. Only floors that the solver proves
+solvable within the limits are kept, so each comes with its optimal
+length. Everything is derived from --seed, so a corpus can be rebuilt.
+
+    python scripts/gen_levels.py --out corpus --sweep ices=1:6 --count 5
+
+writes corpus/ices-1/00.txt ... corpus/ices-6/04.txt and a manifest.csv
+listing every floor with its parameters and optimal length. The
+parameters are recorded after the floor, past the empty line that ends
+it, where the solver does not look.
+"""
+
+import argparse
+import csv
+import os
+import random
+import sys
+
+from qits_run import run_solver
+
+
+PARAMS = ['width', 'height', 'ices', 'gold', 'fires', 'walls']
+
+
+def largest_region(grid, width, height):
+    seen = set()
+    best = []
+    for i in range(1, height + 1):
+        for j in range(1, width + 1):
+            if grid[i][j] == '#' or (i, j) in seen:
+                continue
+            region = []
+            stack = [(i, j)]
+            seen.add((i, j))
+            while stack:
+                ci, cj = stack.pop()
+                region.append((ci, cj))
+                for ni, nj in ((ci-1, cj), (ci+1, cj), (ci, cj-1), (ci, cj+1)):
+                    if grid[ni][nj] != '#' and (ni, nj) not in seen:
+                        seen.add((ni, nj))
+                        stack.append((ni, nj))
+            if len(region) > len(best):
+                best = region
+    return best
+
+
+def generate(rng, width, height, ices, gold, fires, walls):
+    """Returns the text of a random floor, or None if it does not fit."""
+    grid = [['#'] * (width + 2) for _ in range(height + 2)]
+    for i in range(1, height + 1):
+        for j in range(1, width + 1):
+            grid[i][j] = '#' if rng.random() < walls else ' '
+
+    region = largest_region(grid, width, height)
+    if len(region) < 1 + ices + fires:
+        return None
+    for i in range(1, height + 1):
+        for j in range(1, width + 1):
+            grid[i][j] = '#'
+    for i, j in region:
+        grid[i][j] = ' '
+
+    rng.shuffle(region)
+    cells = iter(region)
+    i, j = next(cells)
+    grid[i][j] = '@'
+    for k in range(ices):
+        i, j = next(cells)
+        grid[i][j] = '$' if k < gold else '%'
+    for _ in range(fires):
+        i, j = next(cells)
+        grid[i][j] = '*'
+
+    return ''.join(''.join(row) + '\n' for row in grid)
+
+
+def parse_sweep(spec):
+    name, sep, values = spec.partition('=')
+    if not sep or name not in PARAMS:
+        raise argparse.ArgumentTypeError(f'expected one of {PARAMS}=FROM:TO[:STEP]')
+    if ':' in values:
+        parts = [float(v) if name == 'walls' else int(v) for v in values.split(':')]
+        lo, hi = parts[0], parts[1]
+        step = parts[2] if len(parts) > 2 else (0.1 if name == 'walls' else 1)
+        points = []
+        v = lo
+        while v <= hi + 1e-9:
+            points.append(round(v, 3) if name == 'walls' else v)
+            v += step
+    else:
+        points = [float(v) if name == 'walls' else int(v) for v in values.split(',')]
+    return name, points
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--out', required=True, help='directory to write floors to')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--count', type=int, default=5, help='floors per sweep point')
+    parser.add_argument('--attempts', type=int, default=50,
+                        help='random floors tried per floor kept')
+    parser.add_argument('--sweep', type=parse_sweep, action='append', default=[],
+                        help='vary a parameter, e.g. ices=1:6 or walls=0.1:0.4:0.1; '
+                             'several sweeps make a grid')
+    parser.add_argument('--width', type=int, default=8)
+    parser.add_argument('--height', type=int, default=8)
+    parser.add_argument('--ices', type=int, default=3)
+    parser.add_argument('--gold', type=int, default=0, help='how many of the ices are gold')
+    parser.add_argument('--fires', type=int, default=2)
+    parser.add_argument('--walls', type=float, default=0.2, help='wall density')
+    parser.add_argument('--min-length', type=int, default=1,
+                        help='drop floors solved in fewer pushes')
+    parser.add_argument('--solver', default='./qits')
+    parser.add_argument('--time-limit', type=float, default=10)
+    parser.add_argument('--keep-unsolved', action='store_true',
+                        help='also keep floors not solved within the limits')
+    args = parser.parse_args()
+
+    points = [{}]
+    for name, values in args.sweep:
+        points = [dict(p, **{name: v}) for p in points for v in values]
+
+    # gold ices are some of the ices
+    for point in points:
+        gold = point.get('gold', args.gold)
+        ices = point.get('ices', args.ices)
+        if gold > ices:
+            setting = ' with '.join(f'--sweep {name}={point[name]}' if name in point else
+                                    f'--{name} {getattr(args, name)}' for name in ('gold', 'ices'))
+            parser.error(f'{setting}: more gold ices ({gold}) than ices ({ices})')
+
+    os.makedirs(args.out, exist_ok=True)
+    manifest_path = os.path.join(args.out, 'manifest.csv')
+    with open(manifest_path, 'w', newline='') as manifest:
+        writer = csv.writer(manifest)
+        writer.writerow(['path', *PARAMS, 'seed', 'optimal', 'nodes', 'seconds'])
+
+        for point in points:
+            params = {name: point.get(name, getattr(args, name)) for name in PARAMS}
+            label = '_'.join(f'{k}-{v}' for k, v in point.items()) or 'default'
+            subdir = os.path.join(args.out, label)
+            os.makedirs(subdir, exist_ok=True)
+
+            kept = 0
+            for attempt in range(args.count * args.attempts):
+                if kept == args.count:
+                    break
+                # one seed per floor, so that a single floor can be remade
+                seed = random.Random(f'{args.seed}/{label}/{attempt}').getrandbits(32)
+                floor = generate(random.Random(seed), **params)
+                if floor is None:
+                    continue
+
+                result = run_solver(args.solver, floor, ['--time-limit', str(args.time_limit)])
+                solved = result['solved'] and result['length'] >= args.min_length
+                if not solved and not args.keep_unsolved:
+                    continue
+
+                path = os.path.join(subdir, f'{kept:02d}.txt')
+                with open(path, 'w') as f:
+                    f.write(floor)
+                    f.write('\n')
+                    for name in PARAMS:
+                        f.write(f'{name}={params[name]}\n')
+                    f.write(f'seed={seed}\n')
+                    f.write(f'optimal={result["length"] if solved else ""}\n')
+                writer.writerow([os.path.relpath(path, args.out),
+                                 *(params[name] for name in PARAMS), seed,
+                                 result['length'] if solved else '',
+                                 result['nodes'], result['seconds']])
+                manifest.flush()
+                kept += 1
+
+            print(f'{label}: kept {kept} of {attempt + 1} tried', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -1,8 +1,9 @@
 import random
 
 N = 64
-size = 20 * 14
-categories = ['ICE', 'FIRE', 'ICE_GOLD', 'MAGICIAN']
+# keep in sync with MAX_MAP_W and MAX_MAP_H in qits.h
+size = 64 * 64
+categories = ['ICE', 'FIRE', 'ICE_GOLD', 'MAGICIAN', 'DISPENSER']
 
 
 print(f'static const uint64_t ZOBRIST_VALUES[][{size}] = {{')
@@ -0,0 +1,68 @@
+import os
+import re
+import subprocess
+import time
+
+
+SOLVED_MARK = '====== SOLVED! ======'
+END_MARK = '====== END OF SOLUTION ======'
+EXPLORED_RE = re.compile(r'^Explored (\d+) states', re.M)
+LOWER_BOUND_RE = re.compile(r'^Proven lower bound: no solution within (\d+) pushes', re.M)
+
+
+def run_solver(solver, floor_text, args=()):
+    """Feeds a floor to the solver and measures it.
+
+    Returns a dict with `solved`, `length` (pushes, or None), `nodes`
+    (summed over all iterations), `lower_bound`, `seconds` and `max_rss_kb`.
+    """
+    start = time.monotonic()
+    proc = subprocess.Popen([solver, *args], stdin=subprocess.PIPE,
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                            universal_newlines=True)
+    # a floor fits in the pipe buffer, and the solver reads all of it first
+    proc.stdin.write(floor_text)
+    proc.stdin.close()
+    out = proc.stdout.read()
+    proc.stdout.close()
+    # reap the child ourselves to get its own resource usage
+    _, status, usage = os.wait4(proc.pid, 0)
+    if os.WIFEXITED(status):
+        proc.returncode = os.WEXITSTATUS(status)
+    else:
+        proc.returncode = -os.WTERMSIG(status)
+    seconds = time.monotonic() - start
+
+    solved = SOLVED_MARK in out
+    length = None
+    if solved:
+        body = out.split(SOLVED_MARK, 1)[1].split(END_MARK, 1)[0]
+        length = body.count('STEP -->')
+
+    bounds = LOWER_BOUND_RE.findall(out)
+    return {
+        'solved': solved,
+        'length': length,
+        'nodes': sum(int(n) for n in EXPLORED_RE.findall(out)),
+        'lower_bound': int(bounds[-1]) if bounds else None,
+        'seconds': round(seconds, 3),
+        'max_rss_kb': usage.ru_maxrss,
+        'exit_code': proc.returncode,
+    }
+
+
+def read_floor(path):
+    """Returns the floor part of a level file and its `key=value` notes.
+
+    The solver stops reading at the first empty line, so anything after it
+    is free for metadata.
+    """
+    with open(path) as f:
+        text = f.read()
+    floor, _, rest = text.partition('\n\n')
+    notes = {}
+    for line in rest.splitlines():
+        key, sep, value = line.partition('=')
+        if sep:
+            notes[key.strip()] = value.strip()
+    return floor + '\n', notes
@@ -0,0 +1,182 @@
+"""Runs the solver over a corpus and reports how the search scales.
+
+    python scripts/scaling_report.py corpus --csv report.csv --plot report.png
+
+For every floor (every *.txt under the corpus, or those listed in its
+manifest.csv) records the explored nodes, wall time and peak memory,
+checks the solution length against the optimal one noted in the floor,
+and prints the medians per parameter value. With --plot, draws each
+metric against each swept parameter (needs matplotlib).
+
+With --baseline, compares against an earlier --csv and exits with 1 if
+a floor is no longer solved optimally, or if the total nodes or time
+grew by more than --tolerance; this is meant as a regression guard.
+With --check, exits with 1 if any floor is not solved in the optimal
+length noted in it; the sample floors are checked with
+
+    python scripts/scaling_report.py levels --check
+"""
+
+import argparse
+import csv
+import os
+import statistics
+import sys
+
+from qits_run import read_floor, run_solver
+
+
+PARAMS = ['width', 'height', 'ices', 'gold', 'fires', 'walls']
+METRICS = ['nodes', 'seconds', 'max_rss_kb']
+
+
+def find_floors(corpus):
+    manifest = os.path.join(corpus, 'manifest.csv')
+    if os.path.exists(manifest):
+        with open(manifest) as f:
+            return [row['path'] for row in csv.DictReader(f)]
+    paths = []
+    for root, _, files in os.walk(corpus):
+        for name in files:
+            if name.endswith('.txt'):
+                paths.append(os.path.relpath(os.path.join(root, name), corpus))
+    return sorted(paths)
+
+
+def number(value):
+    try:
+        return int(value)
+    except ValueError:
+        return float(value)
+
+
+def run_corpus(args):
+    rows = []
+    for path in find_floors(args.corpus):
+        floor, notes = read_floor(os.path.join(args.corpus, path))
+        result = run_solver(args.solver, floor, args.solver_args)
+        optimal = int(notes['optimal']) if notes.get('optimal') else None
+        if optimal is None:
+            status = 'solved' if result['solved'] else 'unsolved'
+        elif not result['solved']:
+            status = 'UNSOLVED'
+        elif result['length'] != optimal:
+            status = 'NOT OPTIMAL'
+        else:
+            status = 'ok'
+        row = {'path': path, **{p: notes.get(p, '') for p in PARAMS},
+               'optimal': optimal if optimal is not None else '',
+               'length': result['length'] if result['solved'] else '',
+               'status': status, **{m: result[m] for m in METRICS}}
+        rows.append(row)
+        if args.verbose:
+            print(f'{path}: {status}, {row["nodes"]} nodes, {row["seconds"]}s', file=sys.stderr)
+    return rows
+
+
+def print_summary(rows):
+    swept = [p for p in PARAMS if len({r[p] for r in rows}) > 1]
+    for param in swept:
+        print(f'{param:>8} {"floors":>7} {"nodes":>10} {"seconds":>9} {"rss kB":>8}')
+        for value in sorted({r[param] for r in rows if r[param] != ''}, key=number):
+            group = [r for r in rows if r[param] == value]
+            medians = [statistics.median(r[m] for r in group) for m in METRICS]
+            print(f'{value:>8} {len(group):>7} {medians[0]:>10.0f} {medians[1]:>9.3f} {medians[2]:>8.0f}')
+        print()
+
+    bad = [r for r in rows if r['status'] in ('UNSOLVED', 'NOT OPTIMAL')]
+    for r in bad:
+        print(f'{r["path"]}: {r["status"]} (optimal {r["optimal"]}, got {r["length"] or "none"})')
+    print(f'{len(rows)} floors, {len(bad)} failed, '
+          f'{sum(r["nodes"] for r in rows)} nodes, {sum(r["seconds"] for r in rows):.2f}s')
+    return swept
+
+
+def plot(rows, swept, path):
+    try:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print('matplotlib is not available, no plot drawn', file=sys.stderr)
+        return
+    if not swept:
+        print('no parameter varies across the corpus, no plot drawn', file=sys.stderr)
+        return
+
+    fig, axes = plt.subplots(len(METRICS), len(swept), squeeze=False,
+                             figsize=(4 * len(swept), 3 * len(METRICS)))
+    for col, param in enumerate(swept):
+        points = [r for r in rows if r[param] != '']
+        for row, metric in enumerate(METRICS):
+            ax = axes[row][col]
+            ax.scatter([number(r[param]) for r in points], [r[metric] for r in points], s=8)
+            if metric != 'max_rss_kb':
+                ax.set_yscale('log')
+            ax.set_xlabel(param)
+            ax.set_ylabel(metric)
+    fig.tight_layout()
+    fig.savefig(path)
+
+
+def compare(rows, baseline_path, tolerance):
+    with open(baseline_path) as f:
+        baseline = {r['path']: r for r in csv.DictReader(f)}
+    common = [r for r in rows if r['path'] in baseline]
+    if not common:
+        print('no floors in common with the baseline', file=sys.stderr)
+        return False
+
+    ok = True
+    for r in common:
+        if r['status'] in ('UNSOLVED', 'NOT OPTIMAL') and baseline[r['path']]['status'] == 'ok':
+            print(f'regression: {r["path"]} is {r["status"]}')
+            ok = False
+    for metric in ('nodes', 'seconds'):
+        before = sum(float(baseline[r['path']][metric]) for r in common)
+        after = sum(r[metric] for r in common)
+        change = (after - before) / before if before else 0
+        print(f'{metric}: {before:g} -> {after:g} ({change:+.1%})')
+        if change > tolerance:
+            print(f'regression: {metric} grew by more than {tolerance:.0%}')
+            ok = False
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('corpus', help='directory written by gen_levels.py')
+    parser.add_argument('--solver', default='./qits')
+    parser.add_argument('--solver-args', default='',
+                        help='extra solver options, e.g. "--time-limit 30"')
+    parser.add_argument('--csv', help='write the measurements here')
+    parser.add_argument('--plot', help='draw the metrics into this image')
+    parser.add_argument('--baseline', help='an earlier --csv to compare against')
+    parser.add_argument('--tolerance', type=float, default=0.2,
+                        help='allowed relative growth of total nodes and time')
+    parser.add_argument('--check', action='store_true',
+                        help='fail unless every floor is solved in its noted optimal length')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    args = parser.parse_args()
+    args.solver_args = args.solver_args.split()
+
+    rows = run_corpus(args)
+    if not rows:
+        sys.exit(f'no floors found in {args.corpus}')
+    swept = print_summary(rows)
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+            writer.writeheader()
+            writer.writerows(rows)
+    if args.plot:
+        plot(rows, swept, args.plot)
+    if args.baseline and not compare(rows, args.baseline, args.tolerance):
+        sys.exit(1)
+    if args.check and any(r['status'] in ('UNSOLVED', 'NOT OPTIMAL') for r in rows):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
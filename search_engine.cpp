@@ -0,0 +1,204 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "search_engine.h"
+
+template <class G>
+SearchEngine<G>::SearchEngine(BoardView<G>& bview, const State<G>& root, unsigned int maxDepth,
+                              const StateRanker<G>* ranker):
+    bview(bview), root(root), maxDepth(maxDepth),
+    frames(maxDepth + 1), depth(0), depthLimit_(0), exhaustedDepth_(-1),
+    status_(Status::RUNNING), visited(ranker), exploredStateCount_(0), uniqueStateCount_(0) {
+    // the root is hashed at its normalized magician position
+    exploreBoard(bview, frames[0].pushables);
+    pruneSymmetricMoves(bview, frames[0].pushables);
+    initialHash = bview.hash;
+    initialKey = visited.key(bview);
+    frames[0].count = frames[0].cursor = 0;
+    frames[0].clearedFires = 0;
+}
+
+template <class G>
+void SearchEngine<G>::startIteration() {
+    if (verbose) {
+        printf("Trying %d steps...\n", depthLimit_);
+    }
+
+    started = true;
+    exploredStateCount_ = 0;
+    uniqueStateCount_ = 1;
+    visited.visit(initialKey, depthLimit_);
+
+    depth = 0;
+    if (!enter()) {
+        frames[0].count = frames[0].cursor = 0;
+    }
+}
+
+template <class G>
+void SearchEngine<G>::endIteration() {
+    if (bview.hash != initialHash) {
+        eprintf("Hash mismatch!\n");
+        abort();
+    }
+
+    if (verbose) {
+        printf("Explored %zd states (%zd unique)\n", exploredStateCount_, uniqueStateCount_);
+        printf("Patterns generated = %zd\n", bview.patdb.size());
+    }
+}
+
+template <class G>
+void SearchEngine<G>::finishIteration() {
+    endIteration();
+
+    exhaustedDepth_ = depthLimit_;
+    if (depthLimit_ == maxDepth) {
+        status_ = Status::EXHAUSTED;
+        return;
+    }
+
+    depthLimit_++;
+    startIteration();
+}
+
+// visit the node on top of the stack; returns whether it has moves to try
+template <class G>
+bool SearchEngine<G>::enter() {
+    Frame& f = frames[depth];
+    const State<G>& s = stateAt(depth);
+
+    exploredStateCount_++;
+    if (verbose && exploredStateCount_ % 100000 == 0) {
+        printf("... %zd\n", exploredStateCount_);
+    }
+
+    if (f.clearedFires > bestPartial_.clearedFires ||
+        (f.clearedFires == bestPartial_.clearedFires && depth < bestPartial_.steps.size())) {
+        bestPartial_.clearedFires = f.clearedFires;
+        collectPath(bestPartial_.steps);
+    }
+
+    if (s.clearedFiresPatId == 1) {
+        collectPath(solution_);
+        status_ = Status::SOLVED;
+        return false;
+    }
+
+    // leaves count against the budget as well
+    if (budget.exhausted()) {
+        status_ = Status::STOPPED;
+        return false;
+    }
+
+    if (depth == depthLimit_) {
+        return false;
+    }
+
+    if (f.moves.size() < f.pushables.size()) {
+        f.moves.resize(f.pushables.size());
+    }
+
+    f.count = 0;
+    for (size_t i = 0; i < f.pushables.size(); i++) {
+        int idx = f.pushables[i] >> 8;
+        Direction dir = static_cast<Direction>(f.pushables[i] & 0xff);
+        if (pushIceBlock(bview, s, idx, dir, f.moves[f.count])) {
+            f.count++;
+        }
+    }
+
+    // prioritize a move that clears more fire
+    if (orderMoves || depth == depthLimit_ - 1) {
+        sort(f.moves.begin(), f.moves.begin() + f.count, [](auto& a, auto& b) -> bool {
+            size_t sa = a.posClearedFires.size();
+            size_t sb = b.posClearedFires.size();
+            if (sa != sb) return sa > sb;
+            // break the tie by their indicies
+            return a.state.movedIceIndex < b.state.movedIceIndex;
+        });
+    }
+
+    f.cursor = 0;
+    return true;
+}
+
+// revert the move last taken from the frame on top of the stack
+template <class G>
+void SearchEngine<G>::undoMove() {
+    Frame& f = frames[depth];
+    bview.unapply(f.moves[f.cursor - 1]);
+    bview.setMagicianPos(f.magicianPosOld);
+}
+
+template <class G>
+void SearchEngine<G>::rewind() {
+    while (depth > 0) {
+        depth--;
+        undoMove();
+    }
+}
+
+template <class G>
+void SearchEngine<G>::collectPath(vector<BoardChange<G>>& out) const {
+    out.clear();
+    for (unsigned int d = 0; d < depth; d++) {
+        out.push_back(frames[d].moves[frames[d].cursor - 1]);
+    }
+}
+
+template <class G>
+typename SearchEngine<G>::Status SearchEngine<G>::step(uint64_t n) {
+    if (!started && status_ == Status::RUNNING) {
+        startIteration();
+    }
+
+    while (status_ == Status::RUNNING && n > 0) {
+        Frame& f = frames[depth];
+
+        if (f.cursor == f.count) {
+            if (depth == 0) {
+                finishIteration();
+            } else {
+                depth--;
+                undoMove();
+            }
+            continue;
+        }
+
+        auto& change = f.moves[f.cursor++];
+
+        f.magicianPosOld = bview.magicianPos;
+        bview.apply(change);
+        bview.setMagicianPos(change.state.magicianPos);
+
+        Frame& child = frames[depth + 1];
+        exploreBoard(bview, child.pushables, moveCache);
+
+        if (!visited.visit(visited.key(bview), depthLimit_ - (depth + 1))) {
+            undoMove();
+            continue;
+        }
+        uniqueStateCount_++;
+
+        child.clearedFires = f.clearedFires + change.posClearedFires.size();
+        depth++;
+        n--;
+
+        if (!enter()) {
+            child.count = child.cursor = 0;
+        }
+    }
+
+    if (status_ == Status::SOLVED || status_ == Status::STOPPED) {
+        rewind();
+        endIteration();
+    }
+
+    return status_;
+}
+
+#define INSTANTIATE_SEARCH_ENGINE(W, H) \
+    template class SearchEngine<Geometry<W, H, false>>; \
+    template class SearchEngine<Geometry<W, H, true>>;
+QITS_GEOMETRIES(INSTANTIATE_SEARCH_ENGINE)
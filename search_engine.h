@@ -0,0 +1,100 @@
+#ifndef __QITS_SEARCH_ENGINE_H
+#define __QITS_SEARCH_ENGINE_H
+
+#include "qits.h"
+#include "board_view.h"
+#include "state_rank.h"
+#include "move_cache.h"
+
+// the deepest interesting partial result: most fires cleared, then fewest pushes
+template <class G>
+struct PartialResult {
+    unsigned int clearedFires = 0;
+    vector<BoardChange<G>> steps;
+};
+
+// Iterative deepening over an explicit, preallocated stack of frames.
+// Nothing lives on the machine stack between calls, so the search can be
+// advanced a bounded number of nodes at a time with step().
+template <class G>
+class SearchEngine {
+public:
+    enum class Status {
+        RUNNING,
+        SOLVED,
+        EXHAUSTED,  // no solution within maxDepth pushes
+        STOPPED,    // the budget ran out
+    };
+
+    // states are told apart by their ranks when a ranker is given, and by
+    // their hashes otherwise
+    SearchEngine(BoardView<G>& bview, const State<G>& root, unsigned int maxDepth,
+                 const StateRanker<G>* ranker = nullptr);
+
+    // advance the search by at most n nodes
+    Status step(uint64_t n);
+
+    Status status() const { return status_; }
+    unsigned int depthLimit() const { return depthLimit_; }
+    // the last depth limit that was searched through without a solution
+    int exhaustedDepth() const { return exhaustedDepth_; }
+    size_t exploredStateCount() const { return exploredStateCount_; }
+    size_t uniqueStateCount() const { return uniqueStateCount_; }
+
+    const vector<BoardChange<G>>& solution() const { return solution_; }
+    const PartialResult<G>& bestPartial() const { return bestPartial_; }
+
+    SearchBudget budget;
+    bool verbose = true;
+    // optional, and may be shared with other searches on the same floor
+    MoveCache<G>* moveCache = nullptr;
+    // try the moves that clear the most fires first at every depth, not
+    // just right above the depth limit
+    bool orderMoves = false;
+
+private:
+    struct Frame {
+        vector<int> pushables;
+        vector<BoardChange<G>> moves;
+        size_t count;
+        size_t cursor;
+        // undo record of the move taken from this frame
+        unsigned int magicianPosOld;
+        unsigned int clearedFires;
+    };
+
+    BoardView<G>& bview;
+    State<G> root;
+    uint64_t initialHash;
+    uint64_t initialKey;
+    const unsigned int maxDepth;
+
+    vector<Frame> frames;
+    unsigned int depth;
+    unsigned int depthLimit_;
+    int exhaustedDepth_;
+    Status status_;
+    bool started = false;
+
+    // a state is searched again when reached with more pushes left than
+    // before, as the earlier visit may have run into the depth limit
+    VisitedStates<G> visited;
+    size_t exploredStateCount_;
+    size_t uniqueStateCount_;
+    vector<BoardChange<G>> solution_;
+    PartialResult<G> bestPartial_;
+
+    const State<G>& stateAt(unsigned int d) const {
+        return d == 0 ? root : frames[d-1].moves[frames[d-1].cursor - 1].state;
+    }
+
+    void startIteration();
+    void endIteration();
+    void finishIteration();
+    bool enter();
+    void undoMove();
+    void rewind();
+    void collectPath(vector<BoardChange<G>>& out) const;
+};
+
+#endif  // __QITS_SEARCH_ENGINE_H
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <new>
+#include "state_rank.h"
+
+static uint64_t saturatingAdd(uint64_t a, uint64_t b) {
+    uint64_t r;
+    return __builtin_add_overflow(a, b, &r) ? UINT64_MAX : r;
+}
+
+static uint64_t saturatingMul(uint64_t a, uint64_t b) {
+    uint64_t r;
+    return __builtin_mul_overflow(a, b, &r) ? UINT64_MAX : r;
+}
+
+template <class G>
+StateRanker<G>::StateRanker(const BoardConfiguration<G>& config): config(config) {
+    for (int p = 0; p < G::MAP_SIZE; p++) {
+        cellIndex[p] = -1;
+        if (config.map[p] != ObjectType::WALL && config.map[p] != ObjectType::DISPENSER) {
+            cellIndex[p] = cells.size();
+            cells.push_back(p);
+        }
+    }
+
+    normalCount = count(config.iceType.begin(), config.iceType.end(), 0);
+    goldCount = config.iceType.size() - normalCount;
+
+    // Pascal's triangle, saturated; only the sizes below are ever summed
+    size_t n = cells.size(), k = max(normalCount, goldCount);
+    binom.assign(n + 1, vector<uint64_t>(k + 1, 0));
+    for (size_t i = 0; i <= n; i++) {
+        binom[i][0] = 1;
+        for (size_t j = 1; j <= min(i, k); j++) {
+            binom[i][j] = saturatingAdd(binom[i-1][j-1], binom[i-1][j]);
+        }
+    }
+
+    auto offsets = [&](size_t count, vector<uint64_t>& offset) {
+        offset.assign(count + 2, 0);
+        for (size_t j = 0; j <= count; j++) {
+            offset[j+1] = saturatingAdd(offset[j], binom[n][j]);
+        }
+        return offset[count + 1];
+    };
+    uint64_t normalSets = offsets(normalCount, normalOffset);
+    goldSets = offsets(goldCount, goldOffset);
+
+    size_t F = config.fires.size(), D = config.dispensers.size();
+    size_ = saturatingMul(normalSets, goldSets);
+    size_ = F + D < 64 ? saturatingMul(size_, uint64_t(1) << (F + D)) : UINT64_MAX;
+    size_ = saturatingMul(size_, n);
+
+    // fires and dispensers are mapped onto their own kind by a symmetry
+    unordered_map<int, int> fireAt, dispenserAt;
+    for (size_t f = 0; f < F; f++) {
+        fireAt[config.fires[f]] = f;
+    }
+    for (size_t d = 0; d < D; d++) {
+        dispenserAt[config.dispensers[d].first] = d;
+    }
+
+    size_t S = config.symmetries.size() + 1;
+    firePerm.assign(S, vector<int>(F));
+    dispenserPerm.assign(S, vector<int>(D));
+    for (size_t s = 0; s < S; s++) {
+        auto image = [&](int p) { return s == 0 ? p : config.symmetries[s-1].cell[p]; };
+        for (size_t f = 0; f < F; f++) {
+            firePerm[s][f] = fireAt.at(image(config.fires[f]));
+        }
+        for (size_t d = 0; d < D; d++) {
+            dispenserPerm[s][d] = dispenserAt.at(image(config.dispensers[d].first));
+        }
+    }
+}
+
+// the rank of the board as seen through symmetry s - 1; the symmetries
+// are involutions, so the image has an ice block at p when the board has
+// one at cell[p]
+template <class G>
+uint64_t StateRanker<G>::rankImage(const BoardView<G>& bview, size_t s) const {
+    const Symmetry<G>* sym = s ? &config.symmetries[s-1] : nullptr;
+
+    uint64_t normal = 0, gold = 0;
+    size_t kn = 0, kg = 0;
+    for (size_t c = 0; c < cells.size(); c++) {
+        int p = sym ? sym->cell[cells[c]] : cells[c];
+        int idx = bview.iceToIndex[p];
+        if (idx < 0) {
+            continue;
+        }
+        if (config.iceType[idx] == 1) {
+            gold += binom[c][++kg];
+        } else {
+            normal += binom[c][++kn];
+        }
+    }
+
+    uint64_t r = (normalOffset[kn] + normal) * goldSets + goldOffset[kg] + gold;
+
+    for (size_t f = 0; f < config.fires.size(); f++) {
+        bool cleared = !bview.isMarked(config.fires[firePerm[s][f]]);
+        r = (r << 1) | cleared;
+    }
+    if constexpr (G::SPECIAL_TILES) {
+        for (size_t d = 0; d < config.dispensers.size(); d++) {
+            bool charged = bview.dispenserIce[config.dispensers[dispenserPerm[s][d]].first] >= 0;
+            r = (r << 1) | charged;
+        }
+    }
+
+    unsigned int magicianPos = s ? bview.symMagicianPos[s-1] : bview.magicianPos;
+    return r * cells.size() + cellIndex[magicianPos];
+}
+
+template <class G>
+uint64_t StateRanker<G>::canonicalRank(const BoardView<G>& bview) const {
+    uint64_t r = rankImage(bview, 0);
+    for (size_t s = 1; s <= config.symmetries.size(); s++) {
+        r = min(r, rankImage(bview, s));
+    }
+    return r;
+}
+
+template <class G>
+VisitedStates<G>::VisitedStates(const StateRanker<G>* ranker): ranker(ranker) {
+    if (ranker) {
+        depthByRank.reset(static_cast<uint8_t*>(calloc(ranker->size(), 1)));
+        if (!depthByRank) {
+            throw bad_alloc();
+        }
+    }
+}
+
+#define INSTANTIATE_STATE_RANK(W, H) \
+    template class StateRanker<Geometry<W, H, false>>; \
+    template class StateRanker<Geometry<W, H, true>>; \
+    template class VisitedStates<Geometry<W, H, false>>; \
+    template class VisitedStates<Geometry<W, H, true>>;
+QITS_GEOMETRIES(INSTANTIATE_STATE_RANK)
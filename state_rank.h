@@ -0,0 +1,101 @@
+#ifndef __QITS_STATE_RANK_H
+#define __QITS_STATE_RANK_H
+
+#include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include "qits.h"
+#include "board_view.h"
+
+// A perfect hash of the states of a floor into [0, size()). A state is
+//
+//     (normal ice cells, gold ice cells, cleared fires, charged dispensers,
+//      normalized magician cell)
+//
+// where each set of ice cells is ranked with the combinatorial number
+// system over the cells an ice block may occupy, counting the sets of
+// every size up to the number of such blocks, as they may be destroyed.
+// Not every rank is a reachable state, but no two states share one.
+template <class G>
+class StateRanker {
+public:
+    StateRanker(const BoardConfiguration<G>& config);
+
+    // the number of ranks, or UINT64_MAX if it does not fit
+    uint64_t size() const { return size_; }
+
+    // the smallest rank among the current board and its symmetric images;
+    // only meaningful right after exploreBoard()
+    uint64_t canonicalRank(const BoardView<G>& bview) const;
+
+private:
+    const BoardConfiguration<G>& config;
+
+    // the cells that an ice block or the magician may be on, and back
+    vector<int> cells;
+    int cellIndex[G::MAP_SIZE];
+
+    size_t normalCount, goldCount;
+    // binom[n][k]; offset[k]: the number of sets smaller than k
+    vector<vector<uint64_t>> binom;
+    vector<uint64_t> normalOffset, goldOffset;
+    uint64_t goldSets;
+    uint64_t size_;
+
+    // firePerm[s][f]: the fire that fire f is the image of under symmetry
+    // s - 1; s = 0 is the identity, likewise for dispensers
+    vector<vector<int>> firePerm, dispenserPerm;
+
+    uint64_t rankImage(const BoardView<G>& bview, size_t s) const;
+};
+
+// How deep below each state has been searched without finding a solution,
+// over all iterations of a search. A state reached again with no more
+// pushes left than that need not be searched again. States are keyed by
+// canonical hash, or by canonical rank into a plain byte array when a
+// StateRanker is given; then nothing is hashed and nothing collides. The
+// array comes from calloc(), so only the pages of states reached are ever
+// backed by memory, however many states the ranker counts.
+template <class G>
+class VisitedStates {
+public:
+    VisitedStates(const StateRanker<G>* ranker = nullptr);
+
+    bool isRanked() const { return ranker != nullptr; }
+
+    // the key of the current board; only meaningful right after exploreBoard()
+    inline uint64_t key(const BoardView<G>& bview) const {
+        return ranker ? ranker->canonicalRank(bview) : bview.canonicalHash();
+    }
+
+    // records a state about to be searched `remaining` pushes deep; returns
+    // false if it has been searched at least as deep before
+    inline bool visit(uint64_t key, unsigned int remaining) {
+        // 0 stands for a state never seen
+        unsigned int depth = remaining + 1;
+        if (ranker) {
+            uint8_t& d = depthByRank[key];
+            if (d >= depth) {
+                return false;
+            }
+            d = depth;
+            return true;
+        }
+
+        auto [it, inserted] = depthByHash.insert({key, depth});
+        if (!inserted) {
+            if (it->second >= depth) {
+                return false;
+            }
+            it->second = depth;
+        }
+        return true;
+    }
+
+private:
+    const StateRanker<G>* ranker;
+    unordered_map<uint64_t, unsigned int> depthByHash;
+    unique_ptr<uint8_t[], decltype(&free)> depthByRank {nullptr, free};
+};
+
+#endif  // __QITS_STATE_RANK_H